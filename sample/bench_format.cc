@@ -0,0 +1,301 @@
+#include "../seformat.h"
+#include "../setimer.h"
+
+#include <cstdio>
+#include <cinttypes>
+#include <charconv>
+#include <random>
+#include <cmath>
+#include <sstream>
+#include <new>
+#include <cstdlib>
+#include <map>
+
+#if __has_include(<format>)
+#include <format>
+#endif
+
+using namespace std;
+
+namespace bench {
+
+size_t sink = 0; // printed at exit so nothing gets optimized away
+size_t allocations = 0;
+
+struct result {
+    double ns;
+    double allocs;
+};
+
+template <class F>
+result run(size_t n, F&& f) {
+    auto allocs = allocations;
+    st::Timer timer;
+    timer.Start();
+    for (size_t i = 0; i < n; i++)
+        f(i);
+    auto total = timer.Total();
+    return {chrono::duration<double, nano>(total).count() / n, double(allocations - allocs) / n};
+}
+
+void report(string_view name, result r) {
+    printf("%-44s %8.2f ns/call %6.2f allocs/call\n", string(name).c_str(), r.ns, r.allocs);
+}
+
+void section(string_view name) {
+    printf("\n== %s ==\n", string(name).c_str());
+}
+
+template <class T>
+vector<T> random_values(size_t n) {
+    mt19937_64 rng{42};
+    vector<T> v(n);
+    for (auto& x : v) {
+        // mix all magnitudes so every digit count gets hit
+        auto bits = rng() % numeric_limits<T>::digits + 1;
+        x = static_cast<T>(rng() >> (64 - bits));
+        if constexpr (is_signed_v<T>)
+            if (rng() & 1) x = -x;
+    }
+    return v;
+}
+
+template <class T>
+void integers(string_view type, const char* printf_fmt) {
+    constexpr size_t n = 1 << 20;
+    auto values = random_values<T>(1024);
+    char buf[128];
+
+    section(type);
+    report(st::format("{} st::format", type), run(n, [&](size_t i) {
+        sink += st::format("{}", values[i & 1023]).size();
+    }));
+    report(st::format("{} st::format_to", type), run(n, [&](size_t i) {
+        sink += st::format_to(buf, "{}", values[i & 1023]) - buf;
+    }));
+    report(st::format("{} st::format_to hex", type), run(n, [&](size_t i) {
+        sink += st::format_to(buf, "{:#x}", values[i & 1023]) - buf;
+    }));
+    report(st::format("{} str_process::write_integer", type), run(n, [&](size_t i) {
+        auto end = buf + sizeof(buf);
+        sink += end - st::str_process::write_integer(end, values[i & 1023]);
+    }));
+    report(st::format("{} snprintf", type), run(n, [&](size_t i) {
+        sink += snprintf(buf, sizeof(buf), printf_fmt, values[i & 1023]);
+    }));
+    report(st::format("{} std::to_chars", type), run(n, [&](size_t i) {
+        sink += to_chars(buf, buf + sizeof(buf), values[i & 1023]).ptr - buf;
+    }));
+    report(st::format("{} std::to_chars hex", type), run(n, [&](size_t i) {
+        sink += to_chars(buf, buf + sizeof(buf), values[i & 1023], 16).ptr - buf;
+    }));
+    report(st::format("{} std::ostringstream", type), run(n, [&](size_t i) {
+        ostringstream os;
+        os << values[i & 1023];
+        sink += os.str().size();
+    }));
+#ifdef __cpp_lib_format
+    report(st::format("{} std::format", type), run(n, [&](size_t i) {
+        sink += std::format("{}", values[i & 1023]).size();
+    }));
+    report(st::format("{} std::format_to", type), run(n, [&](size_t i) {
+        sink += std::format_to(buf, "{}", values[i & 1023]) - buf;
+    }));
+#endif
+}
+
+void floats() {
+    constexpr size_t n = 1 << 20;
+    mt19937_64 rng{42};
+    vector<double> values(1024);
+    for (auto& x : values)
+        x = ldexp(uniform_real_distribution<double>{-1, 1}(rng), int(rng() % 64) - 32);
+    char buf[128];
+
+    section("double");
+    report("double st::format", run(n, [&](size_t i) {
+        sink += st::format("{}", values[i & 1023]).size();
+    }));
+    report("double st::format_to shortest", run(n, [&](size_t i) {
+        sink += st::format_to(buf, "{}", values[i & 1023]) - buf;
+    }));
+    report("double st::format_to {:.3}", run(n, [&](size_t i) {
+        sink += st::format_to(buf, "{:.3}", values[i & 1023]) - buf;
+    }));
+    report("double st::format_to {:e}", run(n, [&](size_t i) {
+        sink += st::format_to(buf, "{:e}", values[i & 1023]) - buf;
+    }));
+    report("double snprintf %.17g", run(n, [&](size_t i) {
+        sink += snprintf(buf, sizeof(buf), "%.17g", values[i & 1023]);
+    }));
+    report("double snprintf %.3f", run(n, [&](size_t i) {
+        sink += snprintf(buf, sizeof(buf), "%.3f", values[i & 1023]);
+    }));
+    report("double std::to_chars", run(n, [&](size_t i) {
+        sink += to_chars(buf, buf + sizeof(buf), values[i & 1023]).ptr - buf;
+    }));
+    report("double std::ostringstream", run(n, [&](size_t i) {
+        ostringstream os;
+        os << values[i & 1023];
+        sink += os.str().size();
+    }));
+#ifdef __cpp_lib_format
+    report("double std::format", run(n, [&](size_t i) {
+        sink += std::format("{}", values[i & 1023]).size();
+    }));
+    report("double std::format {:.3f}", run(n, [&](size_t i) {
+        sink += std::format("{:.3f}", values[i & 1023]).size();
+    }));
+#endif
+}
+
+void strings() {
+    constexpr size_t n = 1 << 20;
+    const string words[] = {"a", "seformat", "a somewhat longer string value", "", "padding"};
+    char buf[128];
+
+    section("string");
+    report("string st::format {}", run(n, [&](size_t i) {
+        sink += st::format("{}", words[i % 5]).size();
+    }));
+    report("string st::format_to {:>20}", run(n, [&](size_t i) {
+        sink += st::format_to(buf, "{:>20}", words[i % 5]) - buf;
+    }));
+    report("string st::format_to {:*^20}", run(n, [&](size_t i) {
+        sink += st::format_to(buf, "{:*^20}", words[i % 5]) - buf;
+    }));
+    report("string snprintf %20s", run(n, [&](size_t i) {
+        sink += snprintf(buf, sizeof(buf), "%20s", words[i % 5].c_str());
+    }));
+    report("string std::ostringstream setw", run(n, [&](size_t i) {
+        ostringstream os;
+        os.width(20);
+        os << words[i % 5];
+        sink += os.str().size();
+    }));
+#ifdef __cpp_lib_format
+    report("string std::format_to {:>20}", run(n, [&](size_t i) {
+        sink += std::format_to(buf, "{:>20}", words[i % 5]) - buf;
+    }));
+#endif
+}
+
+void ranges() {
+    constexpr size_t n = 1 << 16;
+    auto ints = random_values<int>(64);
+    map<string, int> dict;
+    for (int i = 0; i < 16; i++)
+        dict[st::format("key{}", i)] = ints[i];
+
+    section("range");
+    report("vector<int>[64] st::format", run(n, [&](size_t) {
+        sink += st::format("{}", ints).size();
+    }));
+    report("vector<int>[64] st::format {:[]:#x}", run(n, [&](size_t) {
+        sink += st::format("{:[]:#x}", ints).size();
+    }));
+    report("vector<int>[64] snprintf loop", run(n, [&](size_t) {
+        char buf[1024];
+        size_t len = 0;
+        buf[len++] = '[';
+        for (size_t i = 0; i < ints.size(); i++)
+            len += snprintf(buf + len, sizeof(buf) - len, i ? ", %d" : "%d", ints[i]);
+        buf[len++] = ']';
+        sink += string(buf, len).size();
+    }));
+    report("vector<int>[64] std::ostringstream", run(n, [&](size_t) {
+        ostringstream os;
+        os << '[';
+        for (size_t i = 0; i < ints.size(); i++)
+            os << (i ? ", " : "") << ints[i];
+        os << ']';
+        sink += os.str().size();
+    }));
+    report("map<string, int>[16] st::format", run(n, [&](size_t) {
+        sink += st::format("{}", dict).size();
+    }));
+    auto bytes = random_values<uint8_t>(4096);
+    report("uint8_t[4096] st::format_span", run(n / 16, [&](size_t) {
+        sink += st::format_span<uint8_t>(bytes).size();
+    }));
+    report("uint8_t[4096] st::format", run(n / 16, [&](size_t) {
+        sink += st::format("{}", bytes).size();
+    }));
+}
+
+// a typical log line, formatted through every front end
+void log_lines() {
+    using namespace st::format_literal;
+    constexpr size_t n = 1 << 20;
+    constexpr string_view fmt = "[{}] {}:{} request {} took {:.3}ms ({} bytes)";
+    const char* files[] = {"server.cc", "handler.cc", "io.cc"};
+    auto ids = random_values<uint64_t>(1024);
+    const st::FormatParser parser{fmt};
+    char buf[256];
+
+    section("log line");
+    report("log st::format", run(n, [&](size_t i) {
+        sink += st::format(fmt, "info", files[i % 3], i & 1023, ids[i & 1023], i * 0.37, i).size();
+    }));
+    report("log st::format_to", run(n, [&](size_t i) {
+        sink += st::format_to(buf, fmt, "info", files[i % 3], i & 1023, ids[i & 1023], i * 0.37, i) - buf;
+    }));
+    report("log st::FormatParser reused", run(n, [&](size_t i) {
+        sink += parser("info", files[i % 3], i & 1023, ids[i & 1023], i * 0.37, i).size();
+    }));
+    report("log st::FormatParser::format_to", run(n, [&](size_t i) {
+        sink += parser.format_to(buf, "info", files[i % 3], i & 1023, ids[i & 1023], i * 0.37, i) - buf;
+    }));
+    report("log _f literal", run(n, [&](size_t i) {
+        sink += "[{}] {}:{} request {} took {:.3}ms ({} bytes)"_f("info", files[i % 3], i & 1023, ids[i & 1023], i * 0.37, i).size();
+    }));
+    report("log snprintf", run(n, [&](size_t i) {
+        sink += snprintf(buf, sizeof(buf), "[%s] %s:%zu request %" PRIu64 " took %.3fms (%zu bytes)",
+                         "info", files[i % 3], i & 1023, ids[i & 1023], i * 0.37, i);
+    }));
+    report("log std::ostringstream", run(n, [&](size_t i) {
+        ostringstream os;
+        os.setf(ios::fixed);
+        os.precision(3);
+        os << "[info] " << files[i % 3] << ':' << (i & 1023) << " request " << ids[i & 1023]
+           << " took " << i * 0.37 << "ms (" << i << " bytes)";
+        sink += os.str().size();
+    }));
+#ifdef __cpp_lib_format
+    report("log std::format", run(n, [&](size_t i) {
+        sink += std::format("[{}] {}:{} request {} took {:.3f}ms ({} bytes)",
+                            "info", files[i % 3], i & 1023, ids[i & 1023], i * 0.37, i).size();
+    }));
+#endif
+}
+
+}
+
+// count every heap allocation made by the code under test
+// the array and sized forms are replaced too so every new pairs with a matching delete
+void* operator new(size_t size) {
+    ++bench::allocations;
+    if (auto p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc{};
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+int main() {
+    bench::integers<int32_t>("int32", "%" PRId32);
+    bench::integers<uint32_t>("uint32", "%" PRIu32);
+    bench::integers<int64_t>("int64", "%" PRId64);
+    bench::integers<uint64_t>("uint64", "%" PRIu64);
+    bench::floats();
+    bench::strings();
+    bench::ranges();
+    bench::log_lines();
+#ifndef __cpp_lib_format
+    printf("\nstd::format is not available, its rows were skipped\n");
+#endif
+    printf("checksum: %zu\n", bench::sink);
+}
@@ -0,0 +1,138 @@
+#include "../seargs.h"
+#include "../selog.h"
+#include "../setimer.h"
+
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <filesystem>
+
+using namespace std;
+
+namespace bench {
+
+struct config {
+    string_view mode;  // sync or async
+    string_view call;  // log, location or time
+    string_view sink;  // null, file or disabled
+    size_t threads;
+};
+
+struct result {
+    double rate;                  // records per second over all threads, the final flush included
+    double p50, p99, p999, max;   // ns per call, clock reads included
+};
+
+bool json = false;
+
+template <class F>
+result measure(size_t threads, size_t per_thread, F&& call) {
+    vector<vector<int64_t>> latency(threads, vector<int64_t>(per_thread));
+    st::Timer timer;
+    timer.Start();
+    vector<thread> pool;
+    for (size_t t = 0; t < threads; t++)
+        pool.emplace_back([&, t] {
+            auto& lat = latency[t];
+            for (size_t i = 0; i < per_thread; i++) {
+                auto begin = chrono::steady_clock::now();
+                call(t, i);
+                lat[i] = (chrono::steady_clock::now() - begin).count();
+            }
+        });
+    for (auto& th : pool)
+        th.join();
+    st::log::flush();
+    auto total = chrono::duration<double>(timer.Total()).count();
+
+    vector<int64_t> all;
+    all.reserve(threads * per_thread);
+    for (auto& lat : latency)
+        all.insert(all.end(), lat.begin(), lat.end());
+    auto percentile = [&](double q) {
+        auto it = all.begin() + min(all.size() - 1, size_t(q * all.size()));
+        nth_element(all.begin(), it, all.end());
+        return double(*it);
+    };
+    return {threads * per_thread / total, percentile(.5), percentile(.99), percentile(.999),
+            double(*max_element(all.begin(), all.end()))};
+}
+
+result run(const config& cfg, size_t total) {
+    auto per_thread = total / cfg.threads;
+    if (cfg.call == "log")
+        return measure(cfg.threads, per_thread, [](size_t t, size_t i) {
+            st::log::log_info("thread {} record {} value {}", t, i, i * 0.5);
+        });
+    if (cfg.call == "location")
+        return measure(cfg.threads, per_thread, [](size_t t, size_t i) {
+            st::log::location_info("thread {} record {} value {}", t, i, i * 0.5);
+        });
+    return measure(cfg.threads, per_thread, [](size_t t, size_t i) {
+        st::log::time_info("thread {} record {} value {}", t, i, i * 0.5);
+    });
+}
+
+void report(const config& cfg, const result& r) {
+    if (json) {
+        printf("{\"mode\":\"%s\",\"call\":\"%s\",\"sink\":\"%s\",\"threads\":%zu,"
+               "\"records_per_sec\":%.0f,\"p50_ns\":%.0f,\"p99_ns\":%.0f,\"p999_ns\":%.0f,\"max_ns\":%.0f}\n",
+               string(cfg.mode).c_str(), string(cfg.call).c_str(), string(cfg.sink).c_str(), cfg.threads,
+               r.rate, r.p50, r.p99, r.p999, r.max);
+    } else {
+        printf("%-6s %-9s %-9s %2zu threads %12.0f records/s  p50 %7.0f  p99 %8.0f  p99.9 %8.0f  max %9.0f ns\n",
+               string(cfg.mode).c_str(), string(cfg.call).c_str(), string(cfg.sink).c_str(), cfg.threads,
+               r.rate, r.p50, r.p99, r.p999, r.max);
+    }
+    fflush(stdout);
+}
+
+// every call and sink for 1, 2, 4 ... max_threads threads
+void scaling(string_view mode, const string& file, size_t max_threads, size_t total) {
+    for (string_view sink : {"null", "file", "disabled"}) {
+        st::log::open_file(sink == "file" ? file : "/dev/null");
+        st::log::set_min_Level(sink == "disabled" ? st::log::log_level::warning : st::log::log_level::trace);
+        for (string_view call : {"log", "location", "time"})
+            for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+                config cfg{mode, call, sink, threads};
+                report(cfg, run(cfg, total));
+            }
+    }
+}
+
+}
+
+int main(int argc, const char** argv) {
+    st::ArgParser args{"Measures the cost of selog calls: latency percentiles and throughput."};
+    args.setProgramName("bench_log")
+        .AddValueOption("--output", "-o", "file written by the file sink, removed afterwards")
+        .AddValueOption("--threads", "-t", "largest thread count, powers of two up to it are run")
+        .AddValueOption("--records", "-n", "records per run, split over the threads")
+        .AddOption("--json", "-j", "print one JSON object per run instead of a table")
+        .AddHelpOption()
+        .setUnkonwOptionCallBack([](const auto& n) {
+            cout << "unknow option: " << n << '\n'
+                 << "try 'bench_log --help' to get help\n";
+            exit(-1);
+        });
+    if (argc > 1) // Parse prints the usage when there are no arguments at all
+        args.Parse(argc, argv);
+
+    string file = args.OptionEnabled("--output") ? args.OptionValue("--output") : "bench_log.out";
+    size_t max_threads = max<size_t>(thread::hardware_concurrency(), 4);
+    if (args.OptionEnabled("--threads"))
+        max_threads = args.OptionValue<size_t>("--threads");
+    size_t total = 1 << 18;
+    if (args.OptionEnabled("--records"))
+        total = args.OptionValue<size_t>("--records");
+    bench::json = args.OptionEnabled("--json");
+
+    bench::scaling("sync", file, max_threads, total);
+    st::log::start_async();
+    bench::scaling("async", file, max_threads, total);
+    st::log::stop_async();
+
+    st::log::use_stdout();
+    std::filesystem::remove(file);
+}
@@ -1,6 +1,7 @@
 #include "../seargs.h"
 #include "../selog.h"
 #include "../seformat.h"
+#include "../sethread.h"
 
 #include <fstream>
 #include <cstring>
@@ -13,7 +14,7 @@ namespace f2c {
 struct FileName {
     string filename;
 
-    string get() const { return regex_replace(filename, regex{"\\."}, "_"); }
+    string get() const { return st::str_process::replace(filename, ".", "_"); }
     string no_suffix() const {return filename.substr(0, filename.find('.'));}
 };
 
@@ -49,43 +50,30 @@ struct st::Formatter<f2c::File> {
         }
         sf = string(fmt.substr(fmt.find('^')+1));
     }
-    std::string operator()(const f2c::File& t){
-        std::string res;
+    void format_to(st::format_buffer& buf, const f2c::File& t) const {
         switch (tp) {
-        case u8: {
-            for (int i = 0; i < t.data.size(); i++) {
-                res += to_string((unsigned)t.data[i]);
-                if (i != t.data.size() - 1) res += sf;
-            }
-            break;
+        case u8:  return format_words<uint8_t>(buf, t);
+        case u32: return format_words<uint32_t>(buf, t);
+        case u64: return format_words<uint64_t>(buf, t);
         }
-        case u32: {
-            auto data = (uint32_t*)t.data.data();
-            auto item = t.data.size()/4;
-            for (int i = 0; i < item; i++) {
-                res += to_string(data[i]);
-                if (i != item - 1) res += sf;
-            }
-            break;
-        }
-        case u64: {
-            auto data = (uint64_t*)t.data.data();
-            auto item = t.data.size()/8;
-            for (int i = 0; i < item; i++) {
-                res += to_string(data[i]);
-                if (i != item - 1) res += sf;
-            }
-            if (t.data.size() % 8 != 0) {
-                st::log::log_warning("File does not meet the alignment requirements: {}", t.name.filename);
-                uint64_t u;
-                memcpy(&u, data + item, 4);
-                res += sf + to_string(u);
-            }
-            break;
-        }}
-        return res;
     }
-    
+
+    template <class T>
+    void format_words(st::format_buffer& buf, const f2c::File& t) const {
+        if (t.data.size() % sizeof(T) != 0)
+            st::log::log_warning("File does not meet the alignment requirements: {}", t.name.filename);
+        // the tail is padded with zeros
+        vector<T> words((t.data.size() + sizeof(T) - 1) / sizeof(T));
+        if (!t.data.empty()) memcpy(words.data(), t.data.data(), t.data.size());
+
+        st::str_process::span_opt opt;
+        opt.sep = sf;
+        span<const T> s = words;
+        if (s.size() < (1 << 20)) return st::format_span_to(buf, s, opt);
+        static st::ThreadPool pool{max(thread::hardware_concurrency(), 1u)};
+        buf.append(st::format_span(s, opt, pool));
+    }
+
     enum type { u8, u32, u64 };
     type tp;
     string sf;
@@ -103,8 +91,8 @@ struct st::Formatter<f2c::FileName> {
     }
     std::string operator()(const f2c::FileName& t) {
         auto res = s ? t.no_suffix() : t.get();
-        if (l) std::transform(res.begin(), res.end(), res.begin(), [](auto&&c){return tolower(c);});
-        if (u) std::transform(res.begin(), res.end(), res.begin(), [](auto&&c){return toupper(c);});
+        if (l) res = st::str_process::to_lower(res);
+        if (u) res = st::str_process::to_upper(res);
         return res;
     }
     
@@ -149,9 +137,9 @@ int main (int argc, const char** argv) {
         else
             fmt = args.OptionValue("--format");
     }
-    fmt = regex_replace(fmt, regex{"\\$D"}, "0");
-    fmt = regex_replace(fmt, regex{"\\$N"}, "1");
-    fmt = regex_replace(fmt, regex{"\\$L"}, "2");
+    fmt = st::str_process::replace(fmt, "$D", "0");
+    fmt = st::str_process::replace(fmt, "$N", "1");
+    fmt = st::str_process::replace(fmt, "$L", "2");
 
     ofstream op{args.ArgumentValue("output")};
     if (!op.good()) {
@@ -0,0 +1,43 @@
+#include "../seargs.h"
+#include "../selog.h"
+
+#include <fstream>
+
+using namespace std;
+
+int main(int argc, const char** argv) {
+    st::ArgParser args{"Prints the records kept by a selog flight recorder."};
+    args.setProgramName("flight")
+        .AddArgument("file", "flight recorder file")
+        .AddValueOption("--count", "-n", "print only the last n records")
+        .AddHelpOption()
+        .setLossArgumentsCallBack([]{
+            cout << "try 'flight --help' to get help\n";
+            exit(-1);
+        })
+        .setUnkonwOptionCallBack([](const auto& n) {
+            cout << "unknow option: " << n << '\n'
+                 << "try 'flight --help' to get help\n";
+            exit(-1);
+        })
+        .Parse(argc, argv);
+
+    ifstream ifs{args.ArgumentValue("file"), ios::binary};
+    if (!ifs.good()) {
+        cout << "failed to open file: " << args.ArgumentValue("file") << '\n';
+        return -1;
+    }
+    string image{istreambuf_iterator<char>{ifs}, istreambuf_iterator<char>{}};
+
+    size_t n = SIZE_MAX;
+    if (args.OptionEnabled("--count"))
+        n = args.OptionValue<size_t>("--count");
+
+    auto records = st::log::flight_records(image, n);
+    if (records.empty() && image.compare(0, 8, st::log::flight_magic, 8) != 0) {
+        cout << "not a flight recorder file\n";
+        return -1;
+    }
+    for (auto& r : records)
+        cout << r;
+}
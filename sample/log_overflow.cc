@@ -0,0 +1,124 @@
+#include "../seargs.h"
+#include "../selog.h"
+
+#include <cstdio>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+using namespace std;
+
+namespace overflow {
+
+// keeps what it is given and takes a while doing it, so producers outrun the backend
+struct slow_sink : st::log::sink {
+    vector<string> lines;
+    chrono::microseconds delay;
+
+    explicit slow_sink(chrono::microseconds delay) : delay(delay) {}
+
+    void write(string_view str) override {
+        lines.emplace_back(str);
+        // spin, sleeping would take far longer than asked for
+        auto until = chrono::steady_clock::now() + delay;
+        while (chrono::steady_clock::now() < until) {}
+    }
+};
+
+const char* names[] = {"block", "drop_newest", "overwrite_oldest", "grow"};
+
+// every policy keeps each thread's records in order, the lossless ones keep all of them
+bool run(st::log::overflow_policy policy, size_t threads, size_t per_thread, size_t queue_size) {
+    auto sink = make_shared<slow_sink>(chrono::microseconds(2));
+    st::log::set_sinks({sink});
+    st::log::start_async(queue_size, policy, chrono::milliseconds(0));
+    vector<thread> pool;
+    for (size_t t = 0; t < threads; t++)
+        pool.emplace_back([=] {
+            for (size_t i = 0; i < per_thread; i++)
+                st::log::log_info("thread {} record {}", t, i);
+        });
+    for (auto& th : pool)
+        th.join();
+    st::log::flush();
+    size_t flushed = sink->lines.size(); // everything logged before flush() is written by now
+    st::log::stop_async();
+    auto stats = st::log::async_stats();
+
+    vector<long> last(threads, -1);
+    size_t records = 0, out_of_order = 0;
+    for (auto& line : sink->lines) {
+        size_t t;
+        long i;
+        if (sscanf(line.c_str(), "[%*[^]]]: thread %zu record %ld", &t, &i) != 2 || t >= threads) continue;
+        if (i <= last[t]) ++out_of_order;
+        last[t] = i;
+        ++records;
+    }
+    bool lossless = policy == st::log::overflow_policy::block || policy == st::log::overflow_policy::grow;
+    bool ok = out_of_order == 0 && records + stats.dropped == threads * per_thread
+           && flushed == sink->lines.size() && (!lossless || stats.dropped == 0);
+    printf("%-16s %8zu written %8lu dropped %8lu blocked %10zu high water  %zu out of order  %s\n",
+           names[int(policy)], records, (unsigned long)stats.dropped, (unsigned long)stats.blocked,
+           stats.high_water, out_of_order, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// holds the backend on its first record until opened, so the queue stays full
+struct gate_sink : st::log::sink {
+    vector<string> lines;
+    atomic<bool> open = false;
+
+    void write(string_view str) override {
+        while (!open.load()) this_thread::yield();
+        lines.emplace_back(str);
+    }
+};
+
+// drop_newest must still keep a fatal record, it waits for room instead
+bool fatal_kept(size_t queue_size) {
+    auto sink = make_shared<gate_sink>();
+    st::log::set_sinks({sink});
+    st::log::start_async(queue_size, st::log::overflow_policy::drop_newest, chrono::milliseconds(0));
+    for (size_t i = 0; st::log::async_stats().dropped == 0; i++)
+        st::log::log_info("filler {}", i);
+    thread opener{[&] {
+        this_thread::sleep_for(chrono::milliseconds(50));
+        sink->open = true;
+    }};
+    st::log::log_fatal("fatal record on a full queue");
+    opener.join();
+    st::log::stop_async();
+    bool ok = !sink->lines.empty() && sink->lines.back().find("fatal record on a full queue") != string::npos;
+    printf("%-16s fatal record on a full queue %s\n", "drop_newest", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+}
+
+int main(int argc, const char** argv) {
+    st::ArgParser args{"Checks the async overflow policies: order, accounting and flush."};
+    args.setProgramName("log_overflow")
+        .AddValueOption("--records", "-n", "records per thread")
+        .AddValueOption("--threads", "-t", "producer threads")
+        .AddHelpOption()
+        .setUnkonwOptionCallBack([](const auto& n) {
+            cout << "unknow option: " << n << '\n'
+                 << "try 'log_overflow --help' to get help\n";
+            exit(-1);
+        });
+    if (argc > 1) // Parse prints the usage when there are no arguments at all
+        args.Parse(argc, argv);
+
+    size_t per_thread = args.OptionEnabled("--records") ? args.OptionValue<size_t>("--records") : 50000;
+    size_t threads = args.OptionEnabled("--threads") ? args.OptionValue<size_t>("--threads") : 4;
+
+    bool ok = true;
+    for (auto policy : {st::log::overflow_policy::block, st::log::overflow_policy::drop_newest,
+                        st::log::overflow_policy::overwrite_oldest, st::log::overflow_policy::grow})
+        ok &= overflow::run(policy, threads, per_thread, 1 << 12);
+    ok &= overflow::fatal_kept(1 << 12);
+    st::log::use_stdout();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#include "../seargs.h"
+#include "../se_tools.h"
+
+using namespace std;
+
+/**
+ * writes a binary log and returns from main without close_binary or stop_async,
+ * the records still queued must reach the file anyway:
+ *   logbin out.bin -n 20000 && logdec out.bin | grep -c record   # prints 20000
+ */
+int main(int argc, const char** argv) {
+    st::ArgParser args{"Writes INFO_LOG records to a selog binary log and exits without closing it."};
+    args.setProgramName("logbin")
+        .AddArgument("file", "binary log file")
+        .AddValueOption("--count", "-n", "number of records, 20000 by default")
+        .AddOption("--sync", "-s", "write without the async backend")
+        .AddHelpOption()
+        .setLossArgumentsCallBack([]{
+            cout << "try 'logbin --help' to get help\n";
+            exit(-1);
+        })
+        .setUnkonwOptionCallBack([](const auto& n) {
+            cout << "unknow option: " << n << '\n'
+                 << "try 'logbin --help' to get help\n";
+            exit(-1);
+        })
+        .Parse(argc, argv);
+
+    size_t n = args.OptionEnabled("--count") ? args.OptionValue<size_t>("--count") : 20000;
+    if (!args.OptionEnabled("--sync"))
+        st::log::start_async();
+    st::log::open_binary(args.ArgumentValue("file"));
+    for (size_t i = 0; i < n; i++)
+        INFO_LOG("record {} of {} value {}", i, n, i * 0.25);
+}
@@ -0,0 +1,185 @@
+#define SELOG_DISABLE_ANSI
+#include "../seargs.h"
+#include "../selog.h"
+
+#include <fstream>
+#include <map>
+
+using namespace std;
+
+namespace logdec {
+
+using st::log::binary_type;
+
+struct site {
+    st::log::log_level lev;
+    bool with_location;
+    uint64_t line;
+    string_view file, function, fmt;
+    vector<binary_type> types;
+};
+
+// reads the stream written by st::log::open_binary, throws on truncated input
+class reader {
+public:
+    explicit reader(string_view image) : p(image.data()), end(image.data() + image.size()) {}
+
+    bool done() const {return p == end;}
+
+    uint8_t byte() {
+        need(1);
+        return static_cast<uint8_t>(*p++);
+    }
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            auto b = byte();
+            v |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw runtime_error("bad varint");
+    }
+
+    string_view str() {
+        auto size = varint();
+        need(size);
+        string_view s{p, size};
+        p += size;
+        return s;
+    }
+
+    template <class T>
+    T raw() {
+        need(sizeof(T));
+        T v;
+        memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+
+    st::erased_arg arg(binary_type type) {
+        using st::erased_arg;
+        switch (type) {
+        case binary_type::boolean:   return erased_arg::make(raw<bool>());
+        case binary_type::character: return erased_arg::make(raw<char>());
+        case binary_type::int8:      return erased_arg::make(raw<int8_t>());
+        case binary_type::int16:     return erased_arg::make(raw<int16_t>());
+        case binary_type::int32:     return erased_arg::make(raw<int32_t>());
+        case binary_type::int64:     return erased_arg::make(raw<int64_t>());
+        case binary_type::uint8:     return erased_arg::make(raw<uint8_t>());
+        case binary_type::uint16:    return erased_arg::make(raw<uint16_t>());
+        case binary_type::uint32:    return erased_arg::make(raw<uint32_t>());
+        case binary_type::uint64:    return erased_arg::make(raw<uint64_t>());
+        case binary_type::float32:   return erased_arg::make(raw<float>());
+        case binary_type::float64:   return erased_arg::make(raw<double>());
+        case binary_type::float80:   return erased_arg::make(raw<long double>());
+        case binary_type::string:    return erased_arg::make(str());
+        case binary_type::pointer:
+            return erased_arg::make(reinterpret_cast<const void*>(static_cast<uintptr_t>(raw<uint64_t>())));
+        }
+        throw runtime_error("unknown argument type");
+    }
+
+private:
+    void need(size_t n) const {
+        if (size_t(end - p) < n)
+            throw runtime_error("truncated input");
+    }
+
+    const char* p;
+    const char* end;
+};
+
+void decode(string_view image, ostream& os, bool with_time) {
+    if (image.size() < 12 || image.compare(0, 8, st::log::binary_magic, 8) != 0)
+        throw runtime_error("not a selog binary log");
+    reader in{image.substr(8)};
+    if (auto version = in.raw<uint32_t>(); version != st::log::binary_version)
+        throw runtime_error(st::format("unsupported version {}", version));
+
+    map<uint64_t, site> sites;
+    vector<st::erased_arg> args;
+    st::memory_buffer buf;
+    int64_t time = 0;
+    while (!in.done()) {
+        auto tag = in.byte();
+        auto id = in.varint();
+        if (tag == 1) {
+            auto& s = sites[id];
+            s.lev = static_cast<st::log::log_level>(in.byte());
+            s.with_location = in.byte();
+            s.line = in.varint();
+            s.file = in.str();
+            s.function = in.str();
+            s.fmt = in.str();
+            s.types.resize(in.varint());
+            for (auto& t : s.types)
+                t = static_cast<binary_type>(in.byte());
+        } else if (tag == 2) {
+            auto it = sites.find(id);
+            if (it == sites.end())
+                throw runtime_error(st::format("record of undefined site {}", id));
+            auto& s = it->second;
+            auto delta = in.varint();
+            time += static_cast<int64_t>(delta >> 1) ^ -static_cast<int64_t>(delta & 1);
+            args.clear();
+            for (auto t : s.types)
+                args.push_back(in.arg(t));
+
+            buf.clear();
+            if (with_time)
+                st::log::format_time(buf, time);
+            if (s.with_location)
+                st::format_to(buf, "{}:{} in {}:\n\t", s.file, s.line, s.function);
+            st::log::format_titled(buf, st::log::log_level_name(s.lev), s.fmt,
+                                   st::format_args{args.data(), args.size()});
+            os.write(buf.data(), buf.size());
+        } else {
+            throw runtime_error(st::format("unknown entry {}", tag));
+        }
+    }
+}
+
+}
+
+int main(int argc, const char** argv) {
+    st::ArgParser args{"Turns a selog binary log back into text."};
+    args.setProgramName("logdec")
+        .AddArgument("file", "binary log file")
+        .AddValueOption("--output", "-o", "write the text to a file instead of stdout")
+        .AddOption("--time", "-t", "prefix every record with its time")
+        .AddHelpOption()
+        .setLossArgumentsCallBack([]{
+            cout << "try 'logdec --help' to get help\n";
+            exit(-1);
+        })
+        .setUnkonwOptionCallBack([](const auto& n) {
+            cout << "unknow option: " << n << '\n'
+                 << "try 'logdec --help' to get help\n";
+            exit(-1);
+        })
+        .Parse(argc, argv);
+
+    ifstream ifs{args.ArgumentValue("file"), ios::binary};
+    if (!ifs.good()) {
+        cout << "failed to open file: " << args.ArgumentValue("file") << '\n';
+        return -1;
+    }
+    string image{istreambuf_iterator<char>{ifs}, istreambuf_iterator<char>{}};
+
+    ofstream ofs;
+    if (args.OptionEnabled("--output")) {
+        ofs.open(args.OptionValue("--output"), ios::binary);
+        if (!ofs.good()) {
+            cout << "failed to open file: " << args.OptionValue("--output") << '\n';
+            return -1;
+        }
+    }
+    try {
+        logdec::decode(image, ofs.is_open() ? ofs : cout, args.OptionEnabled("--time"));
+    } catch (const exception& e) {
+        cout << "logdec: " << e.what() << '\n';
+        return -1;
+    }
+}
@@ -19,22 +19,51 @@ void hash_combine(std::size_t& seed, const T& v, const Rest&... rest) {
     (hash_combine(seed, rest), ...);
 }
 
-#define TRACE_LOG(...) st::log::log_trace(__VA_ARGS__)
+/**
+ * every *_LOG statement keeps a static st::log::log_site, the format must be a string literal
+ * levels below SELOG_ACTIVE_LEVEL vanish at compile time together with their arguments
+ * `declare` adds statics next to the site, `check` runs after the level check and
+ * `call` gets the site followed by the arguments
+ */
+#define SE_SITE_LOG_IF(level, location, declare, check, call, fmt, ...) do{ \
+    if constexpr (st::log::log_level::level >= st::log::active_level) { \
+        static constexpr st::log::log_site se_log_site{st::log::log_level::level, fmt, \
+                                                       std::source_location::current(), location}; \
+        declare \
+        if (st::log::enabled(st::log::log_level::level) && (check)) \
+            call(se_log_site __VA_OPT__(,) __VA_ARGS__); \
+    }}while(0)
 
-#define DEBUG_LOG(...) st::log::log_debug(__VA_ARGS__)
+#define SE_SITE_LOG(level, location, fmt, ...) \
+    SE_SITE_LOG_IF(level, location, , true, st::log::site_log, fmt __VA_OPT__(,) __VA_ARGS__)
 
-#define INFO_LOG(...) st::log::log_info(__VA_ARGS__)
+#define TRACE_LOG(...) SE_SITE_LOG(trace, false, __VA_ARGS__)
 
-#define CRITICAL_LOG(...) st::log::log_critical(__VA_ARGS__)
+#define DEBUG_LOG(...) SE_SITE_LOG(debug, false, __VA_ARGS__)
 
-#define WARNING_LOG(...) st::log::location_warning(__VA_ARGS__)
+#define INFO_LOG(...) SE_SITE_LOG(info, false, __VA_ARGS__)
 
-#define ERROR_LOG(...) do{st::log::location_error(__VA_ARGS__); \
+#define CRITICAL_LOG(...) SE_SITE_LOG(critical, false, __VA_ARGS__)
+
+#define WARNING_LOG(...) SE_SITE_LOG(warning, true, __VA_ARGS__)
+
+#define ERROR_LOG(...) do{SE_SITE_LOG(error, true, __VA_ARGS__); \
     throw std::runtime_error(__FUNCTION__);}while(0)
 
-#define FATAL_LOG(...) do{st::log::location_fatal(__VA_ARGS__); \
+#define FATAL_LOG(...) do{SE_SITE_LOG(fatal, true, __VA_ARGS__); \
     std::terminate();}while(0)
 
+/**
+ * a *_LOG statement with a per site limit, e.g.
+ *   LIMITED_LOG(warning, st::log::per_second(10), "retrying {}", id);
+ * st::log::one_in(n) samples, st::log::first(n) goes silent after n records
+ * a dropped call costs an atomic update, the arguments are not evaluated
+ */
+#define LIMITED_LOG(level, limit, fmt, ...) \
+    SE_SITE_LOG_IF(level, st::log::log_level::level >= st::log::log_level::warning, \
+                   static constinit st::log::site_limit se_log_limit{limit};, se_log_limit.allow(), \
+                   st::log::limited_log, fmt, se_log_limit __VA_OPT__(,) __VA_ARGS__)
+
 #define SE_STR(x) #x
 #define SE_XSTR(x) SE_STR(x)
 
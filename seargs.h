@@ -7,6 +7,8 @@
 #include <functional>
 #include <sstream>
 #include <cassert>
+#include <charconv>
+#include <cctype>
 
 namespace st {
 
@@ -114,20 +116,34 @@ static const std::string& s2v(const std::string& str) {return str;}
 
 template<class T>
 static T s2v(const std::string& str) {
-    std::istringstream os{str};
-    T t;
-    os >> t;
-    return t;
+    if constexpr (std::is_same_v<T, bool>) {
+        return str == "1" || str == "true";
+    } else if constexpr ((std::is_integral_v<T> && sizeof(T) > 1) || std::is_floating_point_v<T>) {
+        // numbers skip the stream, single chars still read as characters below
+        T t{};
+        auto b = str.data(), e = str.data() + str.size();
+        while (b != e && std::isspace(static_cast<unsigned char>(*b))) ++b;
+        if (b != e && *b == '+') ++b;
+        std::from_chars(b, e, t);
+        return t;
+    } else {
+        std::istringstream os{str};
+        T t;
+        os >> t;
+        return t;
+    }
 }
 
 inline std::string str_replace(const std::string &str, const std::string &from, const std::string &to) {
+    if (from.empty()) return str;
     std::string ret;
+    ret.reserve(str.size());
     std::size_t pos = 0, pre_pos = 0;
     while ((pos = str.find(from, pre_pos)) != std::string::npos) {
-        ret += str.substr(pre_pos, pos - pre_pos) + to;
+        ret.append(str, pre_pos, pos - pre_pos).append(to);
         pre_pos = pos + from.length();
     }
-    ret += str.substr(pre_pos);
+    ret.append(str, pre_pos);
     return ret;
 }
 
@@ -7,9 +7,37 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
-#include <regex>
-#include <numeric>
+#include <string>
+#include <string_view>
+#include <iterator>
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <array>
+#include <limits>
+#include <charconv>
+#include <bit>
+#include <span>
+#include <cstdio>
+#include <cerrno>
+#include <ostream>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__AVX2__)
+#define SE_SIMD_AVX2
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#define SE_SIMD_SSE2
+#endif
+#if defined(SE_SIMD_AVX2) || defined(SE_SIMD_SSE2)
+#include <immintrin.h>
+#endif
 
 #if __cplusplus > 201703L
 #define ST_CFUNC constexpr
@@ -22,6 +50,255 @@
 
 namespace st {
 
+/**
+ * character buffer formatters write into,
+ * derived classes decide where the characters finally go
+ */
+class format_buffer {
+public:
+    format_buffer(const format_buffer&) = delete;
+    format_buffer& operator=(const format_buffer&) = delete;
+
+    char* data() {return ptr_;}
+    const char* data() const {return ptr_;}
+    size_t size() const {return size_;}
+    size_t capacity() const {return capacity_;}
+    std::string_view view() const {return {ptr_, size_};}
+    std::string str() const {return {ptr_, size_};}
+    void clear() {size_ = 0;}
+
+    void reserve(size_t n) {
+        if (n > capacity_) grow(n);
+    }
+
+    /**
+     * commits room for `n` characters the caller writes itself,
+     * nullptr if this buffer cannot provide them in one piece
+     */
+    char* try_append(size_t n) {
+        reserve(size_ + n);
+        if (capacity_ - size_ < n) return nullptr;
+        auto p = ptr_ + size_;
+        size_ += n;
+        return p;
+    }
+
+    void push_back(char c) {
+        reserve(size_ + 1);
+        ptr_[size_++] = c;
+    }
+
+    void append(const char* b, const char* e) {
+        if (size_t n = e - b; size_ + n <= capacity_) {
+            std::memcpy(ptr_ + size_, b, n);
+            size_ += n;
+            return;
+        }
+        while (b != e) {
+            reserve(size_ + (e - b));
+            auto n = std::min<size_t>(e - b, capacity_ - size_);
+            std::memcpy(ptr_ + size_, b, n);
+            size_ += n;
+            b += n;
+        }
+    }
+    void append(std::string_view str) {
+        append(str.data(), str.data() + str.size());
+    }
+
+    void append(size_t n, char c) {
+        while (n > 0) {
+            reserve(size_ + n);
+            auto m = std::min(n, capacity_ - size_);
+            std::memset(ptr_ + size_, c, m);
+            size_ += m;
+            n -= m;
+        }
+    }
+
+protected:
+    format_buffer(char* p = nullptr, size_t sz = 0, size_t cap = 0)
+    : ptr_(p), size_(sz), capacity_(cap) {}
+    ~format_buffer() = default;
+
+    void set(char* p, size_t cap) {
+        ptr_ = p;
+        capacity_ = cap;
+    }
+
+    /**
+     * must leave room for at least one more character
+     */
+    virtual void grow(size_t capacity) = 0;
+
+    char* ptr_;
+    size_t size_;
+    size_t capacity_;
+};
+
+inline constexpr size_t inline_buffer_size = 500;
+
+/**
+ * keeps the first `SIZE` characters inline and only spills to the heap beyond that
+ */
+template <size_t SIZE = inline_buffer_size>
+class basic_memory_buffer final : public format_buffer {
+public:
+    basic_memory_buffer() : format_buffer(store_, 0, SIZE) {}
+    ~basic_memory_buffer() {deallocate();}
+
+    basic_memory_buffer(basic_memory_buffer&& other) noexcept : format_buffer(store_, 0, SIZE) {
+        move(other);
+    }
+    basic_memory_buffer& operator=(basic_memory_buffer&& other) noexcept {
+        deallocate();
+        set(store_, SIZE);
+        move(other);
+        return *this;
+    }
+
+private:
+    void grow(size_t capacity) override {
+        auto cap = std::max(capacity, capacity_ + capacity_ / 2);
+        auto p = new char[cap];
+        std::memcpy(p, ptr_, size_);
+        deallocate();
+        set(p, cap);
+    }
+
+    void deallocate() {
+        if (ptr_ != store_) delete[] ptr_;
+    }
+
+    void move(basic_memory_buffer& other) {
+        size_ = other.size_;
+        if (other.ptr_ == other.store_) {
+            std::memcpy(store_, other.store_, other.size_);
+        } else {
+            set(other.ptr_, other.capacity_);
+            other.set(other.store_, SIZE);
+        }
+        other.size_ = 0;
+    }
+
+    char store_[SIZE];
+};
+
+using memory_buffer = basic_memory_buffer<>;
+
+/**
+ * collects output in small chunks and flushes them into an output iterator
+ */
+template <class OutputIt, class = void>
+class iterator_buffer final : public format_buffer {
+public:
+    explicit iterator_buffer(OutputIt out) : format_buffer(data_, 0, buffer_size), out_(out) {}
+
+    OutputIt out() {
+        flush();
+        return out_;
+    }
+
+private:
+    void grow(size_t) override {flush();}
+    void flush() {
+        out_ = std::copy_n(data_, size_, out_);
+        size_ = 0;
+    }
+
+    static constexpr size_t buffer_size = 256;
+    OutputIt out_;
+    char data_[buffer_size];
+};
+
+/**
+ * writes straight into caller owned memory, the caller guarantees it is large enough
+ */
+template <>
+class iterator_buffer<char*> final : public format_buffer {
+public:
+    explicit iterator_buffer(char* out) : format_buffer(out, 0, SIZE_MAX) {}
+
+    char* out() {return ptr_ + size_;}
+
+private:
+    void grow(size_t) override {}
+};
+
+template <class Container>
+Container& get_container(std::back_insert_iterator<Container> it) {
+    struct accessor : std::back_insert_iterator<Container> {
+        accessor(std::back_insert_iterator<Container> it) : std::back_insert_iterator<Container>(it) {}
+        using std::back_insert_iterator<Container>::container;
+    };
+    return *accessor(it).container;
+}
+
+/**
+ * appends straight into the storage of contiguous containers like std::string
+ */
+template <class Container>
+class iterator_buffer<std::back_insert_iterator<Container>,
+                      std::enable_if_t<std::is_same_v<typename Container::value_type, char> &&
+                                       std::contiguous_iterator<typename Container::iterator>>> final
+: public format_buffer {
+public:
+    explicit iterator_buffer(std::back_insert_iterator<Container> out)
+    : container_(get_container(out)), base_(container_.size()) {}
+    ~iterator_buffer() {container_.resize(base_ + size_);}
+
+    std::back_insert_iterator<Container> out() {
+        container_.resize(base_ + size_);
+        set(container_.data() + base_, size_);
+        return std::back_inserter(container_);
+    }
+
+private:
+    void grow(size_t capacity) override {
+        container_.resize(base_ + std::max(capacity, capacity_ + capacity_ / 2));
+        set(container_.data() + base_, container_.size() - base_);
+    }
+
+    Container& container_;
+    size_t base_;
+};
+
+/**
+ * keeps at most `limit` characters but counts all of them
+ */
+template <class OutputIt>
+class truncating_buffer final : public format_buffer {
+public:
+    truncating_buffer(OutputIt out, size_t limit)
+    : format_buffer(data_, 0, buffer_size), out_(out), limit_(limit) {}
+
+    OutputIt out() {
+        flush();
+        return out_;
+    }
+    size_t count() const {return count_ + size_;}
+
+private:
+    void grow(size_t) override {flush();}
+    void flush() {
+        auto n = count_ < limit_ ? std::min(size_, limit_ - count_) : 0;
+        out_ = std::copy_n(data_, n, out_);
+        count_ += size_;
+        size_ = 0;
+    }
+
+    static constexpr size_t buffer_size = 256;
+    OutputIt out_;
+    size_t limit_, count_ = 0;
+    char data_[buffer_size];
+};
+
+template <class OutputIt>
+struct format_to_n_result {
+    OutputIt out;
+    size_t size;
+};
+
 namespace str_process {
 
 constexpr bool is_digit(char c) {
@@ -44,18 +321,95 @@ constexpr char to_lower(char c) {
     return c + 32;
 }
 
+/**
+ * flips the case of every ascii character in [lo, hi], 16/32 characters per step with SSE2/AVX2
+ */
+ST_CFUNC void ascii_case_map(char* dst, const char* src, size_t n, char lo, char hi) {
+    size_t i = 0;
+    if (!std::is_constant_evaluated()) {
+#ifdef SE_SIMD_AVX2
+        const auto ylo = _mm256_set1_epi8(lo - 1), yhi = _mm256_set1_epi8(hi + 1), yflip = _mm256_set1_epi8(0x20);
+        for (; i + 32 <= n; i += 32) {
+            auto v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            auto m = _mm256_and_si256(_mm256_cmpgt_epi8(v, ylo), _mm256_cmpgt_epi8(yhi, v));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(v, _mm256_and_si256(m, yflip)));
+        }
+#endif
+#ifdef SE_SIMD_SSE2
+        const auto vlo = _mm_set1_epi8(lo - 1), vhi = _mm_set1_epi8(hi + 1), flip = _mm_set1_epi8(0x20);
+        for (; i + 16 <= n; i += 16) {
+            auto v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            auto m = _mm_and_si128(_mm_cmpgt_epi8(v, vlo), _mm_cmpgt_epi8(vhi, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(v, _mm_and_si128(m, flip)));
+        }
+#endif
+    }
+    for (; i < n; ++i)
+        dst[i] = src[i] >= lo && src[i] <= hi ? src[i] ^ 0x20 : src[i];
+}
+
 ST_CFUNC std::string to_upper(std::string_view str) {
     std::string res(str.size(), '\0');
-    std::transform(str.begin(), str.end(), res.begin(), [](auto&& c){return is_lower(c) ? to_upper(c) : c;});
+    ascii_case_map(res.data(), str.data(), str.size(), 'a', 'z');
     return res;
 }
 
 ST_CFUNC std::string to_lower(std::string_view str) {
     std::string res(str.size(), '\0');
-    std::transform(str.begin(), str.end(), res.begin(), [](auto&& c){return is_upper(c) ? to_lower(c) : c;});
+    ascii_case_map(res.data(), str.data(), str.size(), 'A', 'Z');
     return res;
 }
 
+/**
+ * substring search, compares the first and last character of `pat`
+ * against 16/32 positions at once and only verifies the candidates
+ */
+ST_CFUNC size_t find(std::string_view str, std::string_view pat, size_t pos = 0) {
+    constexpr auto npos = std::string_view::npos;
+    const size_t n = str.size(), k = pat.size();
+    if (pos > n) return npos;
+    if (k == 0) return pos;
+    if (k > n - pos) return npos;
+
+    const char* s = str.data();
+    size_t i = pos;
+    if (!std::is_constant_evaluated()) {
+        if (k == 1) {
+            auto p = static_cast<const char*>(std::memchr(s + pos, pat[0], n - pos));
+            return p ? p - s : npos;
+        }
+#ifdef SE_SIMD_AVX2
+        const auto yfirst = _mm256_set1_epi8(pat.front()), ylast = _mm256_set1_epi8(pat.back());
+        for (; i + k - 1 + 32 <= n; i += 32) {
+            auto bf = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+            auto bl = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + k - 1));
+            auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(bf, yfirst), _mm256_cmpeq_epi8(bl, ylast))));
+            for (; mask != 0; mask &= mask - 1) {
+                auto b = std::countr_zero(mask);
+                if (std::memcmp(s + i + b + 1, pat.data() + 1, k - 2) == 0) return i + b;
+            }
+        }
+#endif
+#ifdef SE_SIMD_SSE2
+        const auto first = _mm_set1_epi8(pat.front()), last = _mm_set1_epi8(pat.back());
+        for (; i + k - 1 + 16 <= n; i += 16) {
+            auto bf = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+            auto bl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + k - 1));
+            auto mask = static_cast<uint32_t>(_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last))));
+            for (; mask != 0; mask &= mask - 1) {
+                auto b = std::countr_zero(mask);
+                if (std::memcmp(s + i + b + 1, pat.data() + 1, k - 2) == 0) return i + b;
+            }
+        }
+#endif
+    }
+    for (; i + k <= n; ++i)
+        if (s[i] == pat.front() && std::equal(pat.begin() + 1, pat.end(), s + i + 1)) return i;
+    return npos;
+}
+
 enum class alignmode {
     right,
     left,
@@ -90,30 +444,134 @@ enum class radix {
     binary,
 };
 
-static const std::string num_map = "0123456789ABCDEF";
+enum class float_mode {
+    shortest,   // shortest representation that round-trips
+    fixed,
+    scientific,
+    general
+};
+
+inline constexpr std::string_view num_map = "0123456789ABCDEF";
 
-ST_CFUNC std::string dtos(long num, uint32_t rdx = 10) {
-    if (num == 0) return "0";
-    if (num < 0) return '-' + dtos(-num, rdx);
-    std::string res;
-    while (num > 0) {
-        res.insert(res.begin(), num_map[num % rdx]);
-        num /= rdx;
+// "00" "01" ... "99", two decimal digits per lookup
+inline constexpr auto digits2 = [] {
+    std::array<char, 200> t{};
+    for (int i = 0; i < 100; ++i) {
+        t[i * 2] = '0' + i / 10;
+        t[i * 2 + 1] = '0' + i % 10;
     }
-    return res;
+    return t;
+}();
+
+// enough for the binary form of any integral type plus sign and prefix
+template <class T>
+constexpr size_t integer_buffer_size = std::numeric_limits<T>::digits + 4;
+
+/**
+ * the write_* functions fill digits backward from `end` and return the first character
+ */
+template <class UInt>
+constexpr char* write_decimal(char* end, UInt n) {
+    while (n >= 100) {
+        auto r = static_cast<size_t>(n % 100) * 2;
+        n /= 100;
+        *--end = digits2[r + 1];
+        *--end = digits2[r];
+    }
+    if (n >= 10) {
+        auto r = static_cast<size_t>(n) * 2;
+        *--end = digits2[r + 1];
+        *--end = digits2[r];
+    } else {
+        *--end = '0' + static_cast<char>(n);
+    }
+    return end;
+}
+
+template <unsigned Bits, class UInt>
+constexpr char* write_pow2(char* end, UInt n) {
+    do {
+        *--end = num_map[n & ((1u << Bits) - 1)];
+        n >>= Bits;
+    } while (n != 0);
+    return end;
+}
+
+template <class UInt>
+constexpr char* write_unsigned(char* end, UInt n, uint32_t rdx) {
+    switch (rdx) {
+    case 10:
+        return write_decimal(end, n);
+    case 16:
+        return write_pow2<4>(end, n);
+    case 8:
+        return write_pow2<3>(end, n);
+    case 2:
+        return write_pow2<1>(end, n);
+    default:
+        do {
+            *--end = num_map[n % rdx];
+            n /= rdx;
+        } while (n != 0);
+        return end;
+    }
+}
+
+template <class T>
+constexpr auto unsigned_abs(T num) {
+    using U = std::make_unsigned_t<T>;
+    auto u = static_cast<U>(num);
+    if constexpr (std::is_signed_v<T>)
+        if (num < 0) u = U(0) - u;
+    return u;
+}
+
+template <class T, class = std::enable_if_t<std::is_integral_v<T>>>
+constexpr char* write_integer(char* end, T num, uint32_t rdx = 10) {
+    auto p = write_unsigned(end, unsigned_abs(num), rdx);
+    if (num < 0) *--p = '-';
+    return p;
 }
-ST_CFUNC std::string dtos(long num, radix rdx) {
+
+template <class T, class = std::enable_if_t<std::is_integral_v<T>>>
+constexpr char* write_integer(char* end, T num, radix rdx) {
+    auto u = unsigned_abs(num);
+    char* p;
     switch (rdx) {
     default:
     case radix::decimal:
-        return dtos(num, 10);
+        p = write_decimal(end, u);
+        break;
     case radix::hex:
-        return "0X" + dtos(num, 16);
+        p = write_pow2<4>(end, u);
+        *--p = 'X';
+        *--p = '0';
+        break;
     case radix::octal:
-        return '0' + dtos(num, 8);
+        p = write_pow2<3>(end, u);
+        *--p = '0';
+        break;
     case radix::binary:
-        return "0B" + dtos(num, 2);
+        p = write_pow2<1>(end, u);
+        *--p = 'B';
+        *--p = '0';
+        break;
     }
+    if (num < 0) *--p = '-';
+    return p;
+}
+
+template <class T, class = std::enable_if_t<std::is_integral_v<T>>>
+ST_CFUNC std::string dtos(T num, uint32_t rdx = 10) {
+    char buf[integer_buffer_size<T>];
+    auto end = buf + sizeof(buf);
+    return {write_integer(end, num, rdx), end};
+}
+template <class T, class = std::enable_if_t<std::is_integral_v<T>>>
+ST_CFUNC std::string dtos(T num, radix rdx) {
+    char buf[integer_buffer_size<T>];
+    auto end = buf + sizeof(buf);
+    return {write_integer(end, num, rdx), end};
 }
 
 constexpr long ctod(char c) {
@@ -123,73 +581,341 @@ constexpr long ctod(char c) {
     return 0;
 }
 
-ST_CFUNC long stod(std::string_view str, int rdx = 10) {
-    if (str.front() == '-') {
-        str.remove_prefix(1);
-        return -stod(str, rdx);
+constexpr size_t count_digits(uint64_t n) {
+    for (size_t c = 1;; c += 4, n /= 10000) {
+        if (n < 10) return c;
+        if (n < 100) return c + 1;
+        if (n < 1000) return c + 2;
+        if (n < 10000) return c + 3;
     }
-    long res = 0, b = 1;
-    while (!str.empty()) {
-        auto n = ctod(str.back());
-        res += (n < rdx ? n : 0) * b;
-        b *= rdx;
-        str.remove_suffix(1);
+}
+
+// decimal text of every byte, the length sits in the last slot
+inline constexpr auto byte_digits = [] {
+    std::array<std::array<char, 4>, 256> t{};
+    for (int i = 0; i < 256; ++i) {
+        auto len = count_digits(i);
+        write_decimal(t[i].data() + len, static_cast<unsigned>(i));
+        t[i][3] = static_cast<char>(len);
     }
+    return t;
+}();
+
+/**
+ * options of the bulk span kernel below
+ * every `per_line` elements the separator is replaced with `wrap`, 0 never wraps
+ */
+struct span_opt {
+    radix rdx = radix::decimal;
+    std::string_view sep = ", ";
+    size_t per_line = 0;
+    std::string_view wrap = ",\n";
+};
+
+template <class T>
+constexpr size_t span_element_size(T v, radix rdx) {
+    switch (rdx) {
+    case radix::decimal:
+        if constexpr (sizeof(T) == 1)
+            return byte_digits[v][3];
+        else
+            return count_digits(v);
+    case radix::hex:
+        return 2 + (std::bit_width(static_cast<uint64_t>(v) | 1) + 3) / 4;
+    default: {
+        char tmp[integer_buffer_size<T>];
+        return tmp + sizeof(tmp) - write_integer(tmp + sizeof(tmp), v, rdx);
+    }
+    }
+}
+
+template <class T>
+constexpr char* write_span_element(char* out, T v, radix rdx) {
+    switch (rdx) {
+    case radix::decimal:
+        if constexpr (sizeof(T) == 1) {
+            auto& d = byte_digits[v];
+            for (int i = 0; i < d[3]; ++i)
+                *out++ = d[i];
+            return out;
+        } else {
+            auto end = out + count_digits(v);
+            write_decimal(end, v);
+            return end;
+        }
+    case radix::hex: {
+        auto end = out + span_element_size(v, rdx);
+        write_pow2<4>(end, v);
+        out[0] = '0';
+        out[1] = 'X';
+        return end;
+    }
+    default: {
+        char tmp[integer_buffer_size<T>];
+        auto b = write_integer(tmp + sizeof(tmp), v, rdx);
+        return std::copy(b, tmp + sizeof(tmp), out);
+    }
+    }
+}
+
+/**
+ * exact size of write_span for the same arguments, `index` is the position
+ * of data[0] in the whole span so chunks wrap like the unsplit input
+ */
+template <class T, class = std::enable_if_t<std::is_unsigned_v<T>>>
+constexpr size_t span_size(const T* data, size_t n, const span_opt& opt, size_t index = 0) {
+    size_t size = 0;
+    for (size_t i = 0; i < n; ++i, ++index) {
+        if (index != 0)
+            size += opt.per_line && index % opt.per_line == 0 ? opt.wrap.size() : opt.sep.size();
+        size += span_element_size(data[i], opt.rdx);
+    }
+    return size;
+}
+
+template <class T, class = std::enable_if_t<std::is_unsigned_v<T>>>
+constexpr char* write_span(char* out, const T* data, size_t n, const span_opt& opt, size_t index = 0) {
+    for (size_t i = 0; i < n; ++i, ++index) {
+        if (index != 0) {
+            auto sep = opt.per_line && index % opt.per_line == 0 ? opt.wrap : opt.sep;
+            out = std::copy(sep.begin(), sep.end(), out);
+        }
+        out = write_span_element(out, data[i], opt.rdx);
+    }
+    return out;
+}
+
+// value of a digit in any radix up to 36, 0xFF for everything else
+inline constexpr auto digit_values = [] {
+    std::array<uint8_t, 256> t{};
+    t.fill(0xFF);
+    for (int i = 0; i < 10; ++i)
+        t['0' + i] = i;
+    for (int i = 0; i < 26; ++i)
+        t['A' + i] = t['a' + i] = 10 + i;
+    return t;
+}();
+
+/**
+ * SWAR helpers, `v` holds 8 characters loaded little-endian
+ */
+constexpr bool is_8_digits(uint64_t v) {
+    return ((v & 0xF0F0F0F0F0F0F0F0) | (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) == 0x3333333333333333;
+}
+
+constexpr uint32_t parse_8_digits(uint64_t v) {
+    v -= 0x3030303030303030;
+    v = v * 10 + (v >> 8);
+    v = ((v & 0x000000FF000000FF) * (100 + (1000000ull << 32)) +
+         ((v >> 16) & 0x000000FF000000FF) * (1 + (10000ull << 32))) >> 32;
+    return static_cast<uint32_t>(v);
+}
+
+/**
+ * std::from_chars for every integral type and radix 2 to 36, never allocates
+ * decimal input is consumed 8 digits per step, overflow is reported as result_out_of_range
+ */
+template <class T, class = std::enable_if_t<std::is_integral_v<T> && !std::is_same_v<T, bool>>>
+ST_CFUNC std::from_chars_result from_chars(const char* first, const char* last, T& value, int rdx = 10) {
+    using U = unsigned long long;
+    auto p = first;
+    bool neg = false;
+    if constexpr (std::is_signed_v<T>)
+        if (p != last && *p == '-') {
+            neg = true;
+            ++p;
+        }
+
+    const auto digits = p;
+    U acc = 0;
+    bool overflow = false;
+    if (rdx == 10 && std::endian::native == std::endian::little && !std::is_constant_evaluated()) {
+        // 19 decimal digits always fit in 64 bits
+        while (last - p >= 8 && p - digits + 8 <= 19) {
+            uint64_t chunk;
+            std::memcpy(&chunk, p, 8);
+            if (!is_8_digits(chunk)) break;
+            acc = acc * 100000000 + parse_8_digits(chunk);
+            p += 8;
+        }
+    }
+    for (; p != last; ++p) {
+        U d = digit_values[static_cast<unsigned char>(*p)];
+        if (d >= static_cast<U>(rdx)) break;
+        if (overflow || acc > (std::numeric_limits<U>::max() - d) / rdx)
+            overflow = true;
+        else
+            acc = acc * rdx + d;
+    }
+
+    if (p == digits) return {first, std::errc::invalid_argument};
+    U max = static_cast<U>(std::numeric_limits<T>::max()) + (neg ? 1 : 0);
+    if (overflow || acc > max) return {p, std::errc::result_out_of_range};
+    value = neg ? static_cast<T>(U(0) - acc) : static_cast<T>(acc);
+    return {p, std::errc{}};
+}
+
+template <class T, std::enable_if_t<std::is_floating_point_v<T>, int> = 0>
+std::from_chars_result from_chars(const char* first, const char* last, T& value,
+                                  std::chars_format fmt = std::chars_format::general) {
+    return std::from_chars(first, last, value, fmt);
+}
+
+template <class T, class...Opt>
+ST_CFUNC std::from_chars_result from_chars(std::string_view str, T& value, Opt...opt) {
+    return from_chars(str.data(), str.data() + str.size(), value, opt...);
+}
+
+/**
+ * parses up to the first invalid character, yields 0 if nothing could be parsed or it overflows
+ */
+ST_CFUNC long stod(std::string_view str, int rdx = 10) {
+    long res = 0;
+    from_chars(str, res, rdx);
     return res;
 }
 
 ST_CFUNC long stod(std::string_view str, radix rdx) {
+    bool neg = str.starts_with('-');
+    if (neg) str.remove_prefix(1);
+    int base = 10;
     switch (rdx) {
     case radix::decimal:
-        return stod(str, 10);
+        break;
     case radix::hex:
-        return stod(str, 16);
+        base = 16;
+        if (str.starts_with("0x") || str.starts_with("0X")) str.remove_prefix(2);
+        break;
     case radix::octal:
-        return stod(str, 8);
+        base = 8;
+        break;
     case radix::binary:
-        return stod(str, 2);
+        base = 2;
+        if (str.starts_with("0b") || str.starts_with("0B")) str.remove_prefix(2);
+        break;
     }
+    auto n = stod(str, base);
+    return neg ? -n : n;
 }
 
+/**
+ * returns the end of the written characters, or nullptr if [first, last) is too small
+ * a negative precision means the shortest round-trip digits of the mode
+ */
 template <class T, class = std::enable_if_t<std::is_floating_point_v<T>>>
-ST_CFUNC std::string ftos(T value, uint32_t pre) {
-    std::string result;
-    if (value < 0) {
-        result.push_back('-');
-        value = -value;
+char* write_float(char* first, char* last, T value, float_mode mode, int precision = -1) {
+    std::to_chars_result r;
+    switch (mode) {
+    default:
+    case float_mode::shortest:
+        r = std::to_chars(first, last, value);
+        break;
+    case float_mode::fixed:
+        r = precision < 0 ? std::to_chars(first, last, value, std::chars_format::fixed)
+                          : std::to_chars(first, last, value, std::chars_format::fixed, precision);
+        break;
+    case float_mode::scientific:
+        r = precision < 0 ? std::to_chars(first, last, value, std::chars_format::scientific)
+                          : std::to_chars(first, last, value, std::chars_format::scientific, precision);
+        break;
+    case float_mode::general:
+        r = precision < 0 ? std::to_chars(first, last, value, std::chars_format::general)
+                          : std::to_chars(first, last, value, std::chars_format::general, precision);
+        break;
     }
+    return r.ec == std::errc{} ? r.ptr : nullptr;
+}
 
-    auto int_part = static_cast<int>(value);
-    result += dtos(int_part);
-
-    if (pre > 0) {
-        result.push_back('.');
-        auto frac_part = value - static_cast<T>(int_part);
-        for (std::size_t i = 0; i < pre; ++i) {
-            frac_part *= 10;
-            int digit = static_cast<int>(frac_part);
-            result.push_back(digit + '0');
-            frac_part -= static_cast<T>(digit);
+template <class T, class = std::enable_if_t<std::is_floating_point_v<T>>>
+std::string ftos(T value, float_mode mode = float_mode::shortest, int precision = -1) {
+    std::string res(64, '\0');
+    for (;;) {
+        if (auto end = write_float(res.data(), res.data() + res.size(), value, mode, precision)) {
+            res.resize(end - res.data());
+            return res;
         }
+        res.resize(res.size() * 2);
     }
+}
 
-    return result;
+template <class T, class = std::enable_if_t<std::is_floating_point_v<T>>>
+std::string ftos(T value, uint32_t pre) {
+    return ftos(value, float_mode::fixed, pre);
 }
 
+/**
+ * counts the matches first so the result is allocated exactly once
+ */
 ST_CFUNC std::string replace(std::string_view str, std::string_view r, std::string_view t) {
-    std::string res;
-    while (!str.empty()) {
-        auto p = str.find(r);
-        res.append(str.begin(), str.begin() + p);
-        if (p != str.size()) res.append(t.begin(), t.end());
-        str.remove_prefix(p + r.size());
+    constexpr auto npos = std::string_view::npos;
+    if (r.empty()) return {str.begin(), str.end()};
+
+    size_t count = 0;
+    for (auto p = find(str, r); p != npos; p = find(str, r, p + r.size()))
+        ++count;
+    if (count == 0) return {str.begin(), str.end()};
+
+    std::string res(str.size() - count * r.size() + count * t.size(), '\0');
+    auto out = res.begin();
+    size_t last = 0;
+    for (auto p = find(str, r); p != npos; p = find(str, r, last)) {
+        out = std::copy(str.begin() + last, str.begin() + p, out);
+        out = std::copy(t.begin(), t.end(), out);
+        last = p + r.size();
+    }
+    std::copy(str.begin() + last, str.end(), out);
+    return res;
+}
+
+/**
+ * the pieces point into `str`, which has to outlive them
+ */
+ST_CFUNC std::vector<std::string_view> split(std::string_view str, std::string_view sep) {
+    std::vector<std::string_view> res;
+    if (sep.empty()) {
+        res.push_back(str);
+        return res;
+    }
+    for (size_t b = 0;;) {
+        auto p = find(str, sep, b);
+        res.push_back(str.substr(b, p - b));
+        if (p == std::string_view::npos) break;
+        b = p + sep.size();
+    }
+    return res;
+}
+
+ST_CFUNC std::vector<std::string_view> split(std::string_view str, char sep) {
+    return split(str, std::string_view{&sep, 1});
+}
+
+template <class Range>
+ST_CFUNC std::string join(const Range& parts, std::string_view sep) {
+    size_t size = 0, n = 0;
+    for (auto&& p : parts) {
+        size += std::string_view{p}.size();
+        ++n;
+    }
+    if (n == 0) return {};
+
+    std::string res(size + (n - 1) * sep.size(), '\0');
+    auto out = res.begin();
+    for (bool first = true; auto&& p : parts) {
+        if (!first) out = std::copy(sep.begin(), sep.end(), out);
+        std::string_view str{p};
+        out = std::copy(str.begin(), str.end(), out);
+        first = false;
     }
     return res;
 }
 
 struct fmt_opt {
     constexpr fmt_opt(std::string_view fmt) {
-        for (int i = 0; i < fmt.size(); ++i) {
+        for (size_t i = 0; i < fmt.size(); ++i) {
+            if (i + 1 < fmt.size() && is_align(fmt[i + 1]) && !is_spec(fmt[i])) {
+                placeholder = fmt[i]; // fill character, the alignment follows
+                continue;
+            }
             switch (fmt[i]) {
             case '>':
                 align = alignmode::right;
@@ -211,9 +937,10 @@ struct fmt_opt {
             case '.': {
                 type = cv_type::floating;
                 int buf = 0;
-                while (is_digit(fmt[i+1]))
+                while (i + 1 < fmt.size() && is_digit(fmt[i+1]))
                     buf = buf * 10 + fmt[++i] - '0';
                 floating = buf;
+                precision = true;
                 break;
             }
             case 'd':
@@ -221,6 +948,15 @@ struct fmt_opt {
                 break;
             case 'f':
                 type = cv_type::floating;
+                fmode = float_mode::fixed;
+                break;
+            case 'e':
+                type = cv_type::floating;
+                fmode = float_mode::scientific;
+                break;
+            case 'g':
+                type = cv_type::floating;
+                fmode = float_mode::general;
                 break;
             case 'c':
                 type = cv_type::character;
@@ -233,30 +969,33 @@ struct fmt_opt {
             default:
                 if (is_digit(fmt[i])) {
                     int buf = fmt[i] - 48;
-                    while (is_digit(fmt[i+1]))
+                    while (i + 1 < fmt.size() && is_digit(fmt[i+1]))
                         buf = buf * 10 + fmt[++i] - 48;
                     width = buf;
                     break;
                 }
-                switch (fmt[i+1]) {
-                case '>':
-                    placeholder = fmt[i++];
-                    align = alignmode::right;
-                    break;
-                case '<':
-                    placeholder = fmt[i++];
-                    align = alignmode::left;
-                    break;
-                case '^':
-                    placeholder = fmt[i++];
-                    align = alignmode::middle;
-                    break;
-                default:
-                    __format_throw;
-                    break;
-                }
+                __format_throw;
             }
         }
+        if (type == cv_type::floating && fmode == float_mode::shortest)
+            fmode = float_mode::fixed; // `.N` and `f` keep their fixed meaning
+    }
+
+    static constexpr bool is_align(char c) {
+        return c == '<' || c == '>' || c == '^';
+    }
+
+    // characters with a meaning of their own are never taken as fill, `{:+>8}` is showpos + right
+    static constexpr bool is_spec(char c) {
+        return is_align(c) || is_digit(c) || c == '+' || c == '#' || c == '.' || c == ' '
+            || c == 'd' || c == 'f' || c == 'e' || c == 'g' || c == 'c' || c == 's';
+    }
+
+    /**
+     * precision handed to write_float, `f` without `.N` keeps the default of `floating` digits
+     */
+    constexpr int float_precision() const {
+        return precision || fmode == float_mode::fixed ? (int)floating : -1;
     }
 
     constexpr void read_radix(char c) {
@@ -286,154 +1025,93 @@ struct fmt_opt {
         string
     };
     uint32_t width = 0, floating = 3;
-    bool showpos = false;
+    bool showpos = false, precision = false;
     char placeholder = ' ';
     alignmode align = alignmode::right;
     radix rdx = radix::decimal;
+    float_mode fmode = float_mode::shortest;
     cv_type type = cv_type::unknow;
 };
 
-}
-
-#define SPRC_ str_process::
-
-template <class T, class = void>
-struct Formatter;
-
-class FormatParser {
-public:
-    FormatParser(std::string_view fmt) {
-        parse_context({fmt.data(), fmt.size()});
-    }
-
-    /**
-     * this function is disposable
-     */
-    std::string execute(auto&&... args) {
-        parse(std::index_sequence_for<decltype(args)...>{},
-              std::forward<decltype(args)>(args)...);
-        return std::accumulate(context.begin(), context.end(), std::string{});
-    }
-
-    std::string operator()(auto&&... args) const {
-        auto context_backup = context;
-        parse(std::index_sequence_for<decltype(args)...>{},
-              std::forward<decltype(args)>(args)...);
-        context.swap(context_backup);
-        return std::accumulate(context_backup.begin(), context_backup.end(), std::string{});
-    }
-
-    template <class array_t>
-    std::string parse_array(array_t&& array) const {
-        auto context_backup = context;
-        for (size_t i = 0; auto&& f : array)
-            parse_each(i++, std::forward<decltype(f)>(f));
-        context.swap(context_backup);
-        return std::accumulate(context_backup.begin(), context_backup.end(), std::string{});
-    }
+inline void write_aligned(format_buffer& buf, std::string_view str, const fmt_opt& opt) {
+    if (opt.width <= str.size()) return buf.append(str);
 
-    template<class...Args, size_t...I>
-    void parse(std::index_sequence<I...>, Args&&... args) const {
-        ((parse_each(I, std::forward<Args>(args))), ...);
-    }
-
-    size_t num_args() const {
-        size_t n = 0;
-        for (const auto& [i, _] : holders)
-            if (i + 1 > n)
-                n = i + 1;
-        return n;
+    size_t pad = opt.width - str.size(), left = 0;
+    switch (opt.align) {
+    case alignmode::right:
+        left = pad;
+        break;
+    case alignmode::left:
+        break;
+    case alignmode::middle:
+        left = pad / 2;
+        break;
     }
+    buf.append(left, opt.placeholder);
+    buf.append(str);
+    buf.append(pad - left, opt.placeholder);
+}
 
-private:
-    mutable std::vector<std::string> context;
-    std::unordered_multimap<size_t/*index*/, size_t/*pos of context*/> holders;
-
-private:
-    void parse_context(std::string remaining) {
-        std::regex pattern(R"(\{([^\{\}\\]*)\})"), remove(R"(\\\})");  // 匹配{}内的内容
-    
-        std::smatch match;
-    
-#define REPLACE(str) std::regex_replace(str, remove, "}")
-        while (std::regex_search(remaining, match, pattern)) {
-            // 匹配到的部分
-            const std::string& part1 = match.prefix();  // {}左边的部分
-            const std::string& part2 = match[1];         // {}内的部分
-            if (!part1.empty()) context.push_back(REPLACE(part1));
-            context.push_back(REPLACE(part2));
-    
-            holders.emplace(parse_index(), context.size()-1);
-    
-            remaining = match.suffix();
-        }
-    
-        if (!remaining.empty()) {
-            context.push_back(REPLACE(remaining));
-        }
-#undef REPLACE
-    }
-
-    size_t parse_index() {
-        std::string str = context.back().substr(0, context.back().find(':'));
-        std::stable_partition(str.begin(), str.end(), SPRC_ is_digit);
-        if (!str.empty())
-            return SPRC_ stod(str);
-
-        return holders.size();
-    }
+/**
+ * walks through a format string without allocating,
+ * literal text goes to `on_text` (with `\}` unescaped) and every `{...}` to `on_holder(index, spec, raw)`
+ */
+template <class TextHandler, class HolderHandler>
+constexpr void parse_format(std::string_view fmt, TextHandler&& on_text, HolderHandler&& on_holder) {
+    auto text = [&](std::string_view str) {
+        for (size_t p; (p = str.find("\\}")) != str.npos; str.remove_prefix(p + 2)) {
+            if (p > 0) on_text(str.substr(0, p));
+            on_text(str.substr(p + 1, 1));
+        }
+        if (!str.empty()) on_text(str);
+    };
 
-    template <class T>
-    void parse_each(size_t I, T&& arg) const {
-        auto [b, e] = holders.equal_range(I);
-        for (auto it = b; it != e; ++it) {
-            auto& str = context[it->second];
-            std::string_view fmt{str};
-            if (auto fi = fmt.find(':'); fi + 1 < fmt.size())
-                 fmt = fmt.substr(fi + 1);
-            else fmt = {};
-            str = Formatter<std::decay_t<T>>{fmt}(std::forward<T>(arg));
+    size_t lit = 0, holders = 0;
+    for (size_t b = fmt.find('{'); b != fmt.npos;) {
+        auto e = fmt.find_first_of("{}\\", b + 1);
+        if (e == fmt.npos) break;
+        if (fmt[e] != '}') {
+            b = fmt.find('{', e);
+            continue;
         }
-    }
-};
 
-struct OneOffFormatParser {
-    OneOffFormatParser(std::string_view fmt) : fmt(fmt) {}
+        text(fmt.substr(lit, b - lit));
+        auto raw = fmt.substr(b + 1, e - b - 1);
+        auto colon = raw.find(':');
+        auto id = raw.substr(0, colon);
+        size_t index = holders++;
+        if (!id.empty()) {
+            index = 0;
+            for (auto c : id)
+                if (is_digit(c)) index = index * 10 + c - '0';
+        }
+        on_holder(index, colon == raw.npos ? std::string_view{} : raw.substr(colon + 1), raw);
 
-    std::string operator()(auto&&... args) {
-        return fmt.execute(std::forward<decltype(args)>(args)...);
+        lit = e + 1;
+        b = fmt.find('{', lit);
     }
-
-    FormatParser fmt;
-};
-
-auto format(std::string_view fmt_str, auto&&... var) {
-    OneOffFormatParser parser{fmt_str};
-    return parser(std::forward<decltype(var)>(var)...);
+    text(fmt.substr(lit));
 }
 
-namespace format_literal {
-    inline auto operator""_f(const char* cstr, size_t size) {
-        return OneOffFormatParser{{cstr, size}};
-    }
 }
 
+#define SPRC_ str_process::
+
+template <class T, class = void>
+struct Formatter;
+
 template <>
 struct Formatter<bool> {
     Formatter(std::string_view fmt) : opt(fmt) {};
-    std::string operator()(bool c) {
-        std::string buf{};
-
+    void format_to(format_buffer& buf, bool c) const {
         switch (opt.type) {
         case SPRC_ fmt_opt::cv_type::integer:
-            buf = c ? "1" : "0";
+            SPRC_ write_aligned(buf, c ? "1" : "0", opt);
             break;
         default:
-            buf = c ? "true" : "false";
+            SPRC_ write_aligned(buf, c ? "true" : "false", opt);
             break;
         }
-
-        return SPRC_ str_align(std::string(opt.width, opt.placeholder), buf, opt.align);
     }
 
     SPRC_ fmt_opt opt;
@@ -442,19 +1120,19 @@ struct Formatter<bool> {
 template <>
 struct Formatter<char> {
     Formatter(std::string_view fmt) : opt(fmt) {};
-    std::string operator()(char c) {
-        std::string buf{};
-
+    void format_to(format_buffer& buf, char c) const {
         switch (opt.type) {
-        case SPRC_ fmt_opt::cv_type::integer:
-            buf = SPRC_ dtos(c, opt.rdx);
+        case SPRC_ fmt_opt::cv_type::integer: {
+            char str[SPRC_ integer_buffer_size<char>];
+            auto end = str + sizeof(str);
+            auto begin = SPRC_ write_integer(end, c, opt.rdx);
+            SPRC_ write_aligned(buf, {begin, size_t(end - begin)}, opt);
             break;
+        }
         default:
-            buf = c;
+            SPRC_ write_aligned(buf, {&c, 1}, opt);
             break;
         }
-
-        return SPRC_ str_align(std::string(opt.width, opt.placeholder), buf, opt.align);
     }
 
     SPRC_ fmt_opt opt;
@@ -469,7 +1147,7 @@ struct is_string<T, std::enable_if_t<std::is_constructible_v<std::string_view, T
 template <class T>
 struct Formatter<T, std::enable_if_t<is_string<T>::value>> {
     Formatter(std::string_view fmt) : opt(fmt) {};
-    std::string operator()(std::string_view str) {return SPRC_ str_align(std::string(opt.width, opt.placeholder), str, opt.align);}
+    void format_to(format_buffer& buf, std::string_view str) const {SPRC_ write_aligned(buf, str, opt);}
 private:
     SPRC_ fmt_opt opt;
 };
@@ -477,20 +1155,20 @@ private:
 template <class T>
 struct Formatter<T, std::enable_if_t<std::is_integral_v<T>>> {
     Formatter(std::string_view fmt) : opt(fmt) {}
-    std::string operator()(T n) {
-        std::string buf{};
-
+    void format_to(format_buffer& buf, T n) const {
         switch (opt.type) {
         case SPRC_ fmt_opt::cv_type::unknow:
-        case SPRC_ fmt_opt::cv_type::integer:
-            buf = SPRC_ dtos(n, opt.rdx);
+        case SPRC_ fmt_opt::cv_type::integer: {
+            char str[SPRC_ integer_buffer_size<T>];
+            auto end = str + sizeof(str);
+            auto begin = SPRC_ write_integer(end, n, opt.rdx);
+            SPRC_ write_aligned(buf, {begin, size_t(end - begin)}, opt);
             break;
+        }
         default:
             __format_throw;
             break;
         }
-
-        return SPRC_ str_align(std::string(opt.width, opt.placeholder), buf, opt.align);
     }
 
 private:
@@ -501,8 +1179,11 @@ private:
 template <class T>
 struct Formatter<T*, std::enable_if_t<!is_string<T*>::value>> {
     Formatter(std::string_view fmt) : opt(fmt) {}
-    std::string operator()(void* n) {
-        return SPRC_ str_align(std::string(opt.width, opt.placeholder), SPRC_ dtos((size_t)n, SPRC_ radix::hex), opt.align);
+    void format_to(format_buffer& buf, const void* n) const {
+        char str[SPRC_ integer_buffer_size<uintptr_t>];
+        auto end = str + sizeof(str);
+        auto begin = SPRC_ write_integer(end, reinterpret_cast<uintptr_t>(n), SPRC_ radix::hex);
+        SPRC_ write_aligned(buf, {begin, size_t(end - begin)}, opt);
     }
 
 private:
@@ -513,21 +1194,27 @@ private:
 template <class T>
 struct Formatter<T, std::enable_if_t<std::is_floating_point_v<T>>> {
     Formatter(std::string_view fmt) : opt(fmt) {}
-    std::string operator()(T n) {
-        std::string buf{};
-
+    void format_to(format_buffer& buf, T n) const {
         switch (opt.type) {
         case SPRC_ fmt_opt::cv_type::unknow:
         case SPRC_ fmt_opt::cv_type::floating:
-            buf = SPRC_ ftos(n, opt.floating);
             break;
         default:
             __format_throw;
             break;
         }
-        if (opt.showpos && n > 0) buf = '+' + buf;
 
-        return SPRC_ str_align(std::string(opt.width, opt.placeholder), buf, opt.align);
+        char str[256];
+        auto begin = str + 1;
+        auto end = SPRC_ write_float(begin, str + sizeof(str), n, opt.fmode, opt.float_precision());
+        if (opt.showpos && n > 0) *--begin = '+';
+        if (end != nullptr)
+            return SPRC_ write_aligned(buf, {begin, size_t(end - begin)}, opt);
+
+        // only huge fixed values end up here
+        auto big = SPRC_ ftos(n, opt.fmode, opt.float_precision());
+        if (opt.showpos && n > 0) big.insert(big.begin(), '+');
+        SPRC_ write_aligned(buf, big, opt);
     }
 
 private:
@@ -535,7 +1222,447 @@ private:
 
 };
 
-#define _to_string(x) Formatter<std::decay_t<decltype(x)>>{{}}((x));
+/**
+ * formatters either write into the buffer via `format_to(buf, value)`,
+ * or return a std::string from `operator()(value)`
+ */
+template <class T>
+concept buffered_formatter = requires (Formatter<T>& f, format_buffer& buf, const T& v) {
+    f.format_to(buf, v);
+};
+
+template <class T>
+void format_arg(format_buffer& buf, std::string_view spec, const T& arg) {
+    Formatter<T> f{spec};
+    if constexpr (buffered_formatter<T>)
+        f.format_to(buf, arg);
+    else
+        buf.append(f(arg));
+}
+
+/**
+ * type erased reference to one argument, built-in types are copied by value and
+ * everything else goes through a pointer to its Formatter, so the formatting
+ * engine below is compiled once instead of per argument list
+ */
+struct erased_arg {
+    enum class kind : uint8_t {
+        none,
+        boolean,
+        character,
+        int64,
+        uint64,
+        float32,
+        float64,
+        float80,
+        string,
+        pointer,
+        custom
+    };
+
+    using custom_func = void (*)(format_buffer&, std::string_view, const void*);
+
+    template <class T>
+    static erased_arg make(const T& v) {
+        using D = std::decay_t<T>;
+        erased_arg a;
+        if constexpr (std::is_same_v<D, bool>) {
+            a.type = kind::boolean;
+            a.b = v;
+        } else if constexpr (std::is_same_v<D, char>) {
+            a.type = kind::character;
+            a.c = v;
+        } else if constexpr (std::is_integral_v<D> && std::is_signed_v<D> && sizeof(D) <= sizeof(long long)) {
+            a.type = kind::int64;
+            a.i = v;
+        } else if constexpr (std::is_integral_v<D> && sizeof(D) <= sizeof(long long)) {
+            a.type = kind::uint64;
+            a.u = v;
+        } else if constexpr (std::is_same_v<D, float>) {
+            a.type = kind::float32;
+            a.f = v;
+        } else if constexpr (std::is_same_v<D, double>) {
+            a.type = kind::float64;
+            a.d = v;
+        } else if constexpr (std::is_same_v<D, long double>) {
+            a.type = kind::float80;
+            a.ld = v;
+        } else if constexpr (is_string<D>::value) {
+            std::string_view str{v};
+            a.type = kind::string;
+            a.str = {str.data(), str.size()};
+        } else if constexpr (std::is_pointer_v<D> && !std::is_function_v<std::remove_pointer_t<D>>) {
+            a.type = kind::pointer;
+            a.ptr = static_cast<D>(v);
+        } else {
+            a.type = kind::custom;
+            a.custom = {std::addressof(v), &format_custom<D>};
+        }
+        return a;
+    }
+
+    template <class T>
+    static void format_custom(format_buffer& buf, std::string_view spec, const void* arg) {
+        format_arg(buf, spec, *static_cast<const T*>(arg));
+    }
+
+    kind type = kind::none;
+    union {
+        bool b;
+        char c;
+        long long i;
+        unsigned long long u;
+        float f;
+        double d;
+        long double ld;
+        struct { const char* data; size_t size; } str;
+        const void* ptr;
+        struct { const void* value; custom_func format; } custom;
+    };
+};
+
+template <size_t N>
+struct format_arg_store {
+    std::array<erased_arg, N> args;
+};
+
+template <class...Args>
+format_arg_store<sizeof...(Args)> make_format_args(const Args&... args) {
+    return {{erased_arg::make(args)...}};
+}
+
+/**
+ * non-owning view of a format_arg_store, only valid during the call it is passed to
+ */
+class format_args {
+public:
+    format_args() = default;
+    template <size_t N>
+    format_args(const format_arg_store<N>& store) : args_(store.args.data()), size_(N) {}
+    // arguments only known at runtime, e.g. decoded from a binary log
+    format_args(const erased_arg* args, size_t size) : args_(args), size_(size) {}
+
+    const erased_arg* get(size_t i) const {return i < size_ ? args_ + i : nullptr;}
+    size_t size() const {return size_;}
+
+private:
+    const erased_arg* args_ = nullptr;
+    size_t size_ = 0;
+};
+
+inline void format_erased(format_buffer& buf, std::string_view spec, const erased_arg& arg) {
+    using kind = erased_arg::kind;
+    switch (arg.type) {
+    case kind::none:
+        break;
+    case kind::boolean:
+        return Formatter<bool>{spec}.format_to(buf, arg.b);
+    case kind::character:
+        return Formatter<char>{spec}.format_to(buf, arg.c);
+    case kind::int64:
+        return Formatter<long long>{spec}.format_to(buf, arg.i);
+    case kind::uint64:
+        return Formatter<unsigned long long>{spec}.format_to(buf, arg.u);
+    case kind::float32:
+        return Formatter<float>{spec}.format_to(buf, arg.f);
+    case kind::float64:
+        return Formatter<double>{spec}.format_to(buf, arg.d);
+    case kind::float80:
+        return Formatter<long double>{spec}.format_to(buf, arg.ld);
+    case kind::string:
+        return Formatter<std::string_view>{spec}.format_to(buf, {arg.str.data, arg.str.size});
+    case kind::pointer:
+        return Formatter<const void*>{spec}.format_to(buf, arg.ptr);
+    case kind::custom:
+        return arg.custom.format(buf, spec, arg.custom.value);
+    }
+}
+
+inline void format_nth(format_buffer& buf, format_args args, size_t n, std::string_view spec, std::string_view raw) {
+    if (auto arg = args.get(n))
+        format_erased(buf, spec, *arg);
+    else
+        buf.append(raw); // no such argument, leave the holder as it is
+}
+
+class FormatParser {
+public:
+    FormatParser(std::string_view fmt) {
+        SPRC_ parse_format(fmt, [this](std::string_view str) {
+            if (segments.empty() || segments.back().index != literal)
+                segments.push_back({literal, text.size(), 0, 0});
+            text.append(str);
+            segments.back().size += str.size();
+        }, [this](size_t index, std::string_view spec, std::string_view raw) {
+            segments.push_back({index, text.size(), raw.size(), spec.size()});
+            text.append(raw);
+        });
+    }
+
+    std::string execute(auto&&... args) const {
+        return (*this)(std::forward<decltype(args)>(args)...);
+    }
+
+    std::string operator()(const auto&... args) const {
+        return vformat(make_format_args(args...));
+    }
+
+    std::string vformat(format_args args) const {
+        memory_buffer buf;
+        vformat_to(buf, args);
+        return buf.str();
+    }
+
+    template <std::output_iterator<char> OutputIt>
+    OutputIt format_to(OutputIt out, const auto&... args) const {
+        iterator_buffer<OutputIt> buf{out};
+        format_to(buf, args...);
+        return buf.out();
+    }
+
+    void format_to(format_buffer& buf, const auto&... args) const {
+        vformat_to(buf, make_format_args(args...));
+    }
+
+    void vformat_to(format_buffer& buf, format_args args) const {
+        write(buf, [&](size_t i, std::string_view spec, std::string_view raw) {
+            format_nth(buf, args, i, spec, raw);
+        });
+    }
+
+    template <class array_t>
+    std::string parse_array(array_t&& array) const {
+        memory_buffer buf;
+        write(buf, [&](size_t i, std::string_view spec, std::string_view raw) {
+            if (i < std::size(array))
+                format_arg(buf, spec, *std::next(std::begin(array), i));
+            else
+                buf.append(raw);
+        });
+        return buf.str();
+    }
+
+    size_t num_args() const {
+        size_t n = 0;
+        for (auto&& s : segments)
+            if (s.index != literal && s.index + 1 > n)
+                n = s.index + 1;
+        return n;
+    }
+
+private:
+    static constexpr size_t literal = SIZE_MAX;
+
+    struct segment {
+        size_t index;      // argument index or `literal`
+        size_t begin, size; // range in text, holders keep their raw content
+        size_t spec;       // length of the spec at the end of a holder
+    };
+
+    std::string text;
+    std::vector<segment> segments;
+
+    template <class F>
+    void write(format_buffer& buf, F&& on_holder) const {
+        for (auto&& s : segments) {
+            std::string_view str{text.data() + s.begin, s.size};
+            if (s.index == literal)
+                buf.append(str);
+            else
+                on_holder(s.index, str.substr(s.size - s.spec), str);
+        }
+    }
+};
+
+inline void vformat_to(format_buffer& buf, std::string_view fmt, format_args args) {
+    SPRC_ parse_format(fmt, [&](std::string_view str) {
+        buf.append(str);
+    }, [&](size_t i, std::string_view spec, std::string_view raw) {
+        format_nth(buf, args, i, spec, raw);
+    });
+}
+
+inline std::string vformat(std::string_view fmt, format_args args) {
+    memory_buffer buf;
+    vformat_to(buf, fmt, args);
+    return buf.str();
+}
+
+void format_to(format_buffer& buf, std::string_view fmt, const auto&... args) {
+    vformat_to(buf, fmt, make_format_args(args...));
+}
+
+template <std::output_iterator<char> OutputIt>
+OutputIt format_to(OutputIt out, std::string_view fmt, const auto&... args) {
+    iterator_buffer<OutputIt> buf{out};
+    format_to(buf, fmt, args...);
+    return buf.out();
+}
+
+template <std::output_iterator<char> OutputIt>
+format_to_n_result<OutputIt> format_to_n(OutputIt out, size_t n, std::string_view fmt, const auto&... args) {
+    truncating_buffer<OutputIt> buf{out, n};
+    format_to(buf, fmt, args...);
+    return {buf.out(), buf.count()};
+}
+
+std::string format(std::string_view fmt_str, const auto&... var) {
+    return vformat(fmt_str, make_format_args(var...));
+}
+
+struct OneOffFormatParser {
+    OneOffFormatParser(std::string_view fmt) : fmt(fmt) {}
+
+    std::string operator()(const auto&... args) const {
+        return format(fmt, args...);
+    }
+
+    std::string_view fmt;
+};
+
+namespace format_literal {
+    inline auto operator""_f(const char* cstr, size_t size) {
+        return OneOffFormatParser{{cstr, size}};
+    }
+}
+
+/**
+ * every record is formatted into a memory_buffer and handed to the sink in one call
+ */
+inline void write_all(std::FILE* f, std::string_view str) {
+    std::fwrite(str.data(), 1, str.size(), f);
+}
+
+inline void write_all_unlocked(std::FILE* f, std::string_view str) {
+#if defined(_WIN32)
+    _fwrite_nolock(str.data(), 1, str.size(), f);
+#elif defined(__GLIBC__)
+    fwrite_unlocked(str.data(), 1, str.size(), f);
+#else
+    std::fwrite(str.data(), 1, str.size(), f);
+#endif
+}
+
+inline void write_all(int fd, std::string_view str) {
+    while (!str.empty()) {
+#ifdef _WIN32
+        auto n = _write(fd, str.data(), (unsigned)str.size());
+#else
+        auto n = ::write(fd, str.data(), str.size());
+#endif
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        str.remove_prefix(n);
+    }
+}
+
+inline void write_all(std::ostream& os, std::string_view str) {
+    os.write(str.data(), str.size());
+}
+
+template <class Sink>
+void vprint(Sink&& sink, std::string_view fmt, format_args args, bool newline = false) {
+    memory_buffer buf;
+    vformat_to(buf, fmt, args);
+    if (newline) buf.push_back('\n');
+    write_all(sink, buf.view());
+}
+
+template <class Sink>
+void print(Sink&& sink, std::string_view fmt, const auto&... args)
+requires requires (std::string_view str) { write_all(sink, str); } {
+    vprint(sink, fmt, make_format_args(args...));
+}
+
+template <class Sink>
+void println(Sink&& sink, std::string_view fmt, const auto&... args)
+requires requires (std::string_view str) { write_all(sink, str); } {
+    vprint(sink, fmt, make_format_args(args...), true);
+}
+
+void print(std::string_view fmt, const auto&... args) {
+    vprint(stdout, fmt, make_format_args(args...));
+}
+
+void println(std::string_view fmt, const auto&... args) {
+    vprint(stdout, fmt, make_format_args(args...), true);
+}
+
+/**
+ * skips the FILE lock, only for streams no other thread touches
+ */
+inline void vprint_unlocked(std::FILE* f, std::string_view fmt, format_args args, bool newline = false) {
+    memory_buffer buf;
+    vformat_to(buf, fmt, args);
+    if (newline) buf.push_back('\n');
+    write_all_unlocked(f, buf.view());
+}
+
+void print_unlocked(std::FILE* f, std::string_view fmt, const auto&... args) {
+    vprint_unlocked(f, fmt, make_format_args(args...));
+}
+
+void println_unlocked(std::FILE* f, std::string_view fmt, const auto&... args) {
+    vprint_unlocked(f, fmt, make_format_args(args...), true);
+}
+
+/**
+ * bulk formatting of unsigned integer spans, meant for dumping binary data as code
+ * the output is sized exactly first and then written in place
+ */
+template <class T, class = std::enable_if_t<std::is_unsigned_v<T>>>
+void format_span_to(format_buffer& buf, std::span<const T> data, const SPRC_ span_opt& opt = {}) {
+    auto size = SPRC_ span_size(data.data(), data.size(), opt);
+    if (auto out = buf.try_append(size)) {
+        SPRC_ write_span(out, data.data(), data.size(), opt);
+    } else {
+        memory_buffer tmp;
+        SPRC_ write_span(tmp.try_append(size), data.data(), data.size(), opt);
+        buf.append(tmp.view());
+    }
+}
+
+template <class T, class = std::enable_if_t<std::is_unsigned_v<T>>>
+std::string format_span(std::span<const T> data, const SPRC_ span_opt& opt = {}) {
+    std::string res(SPRC_ span_size(data.data(), data.size(), opt), '\0');
+    SPRC_ write_span(res.data(), data.data(), data.size(), opt);
+    return res;
+}
+
+/**
+ * same as above but blocks are sized and written on `pool`,
+ * anything with `dispatch(count, callback(begin, end))` like st::ThreadPool works
+ */
+template <class T, class Pool, class = std::enable_if_t<std::is_unsigned_v<T>>>
+std::string format_span(std::span<const T> data, const SPRC_ span_opt& opt, Pool& pool) {
+    constexpr size_t block = 1 << 16;
+    const size_t blocks = (data.size() + block - 1) / block;
+    if (blocks <= 1) return format_span(data, opt);
+
+    std::vector<size_t> offsets(blocks + 1);
+    auto range = [&](size_t b) {
+        return data.subspan(b * block, std::min(block, data.size() - b * block));
+    };
+    pool.dispatch(blocks, [&](size_t begin, size_t end) {
+        for (auto b = begin; b < end; ++b) {
+            auto r = range(b);
+            offsets[b + 1] = SPRC_ span_size(r.data(), r.size(), opt, b * block);
+        }
+    });
+    for (size_t b = 0; b < blocks; ++b)
+        offsets[b + 1] += offsets[b];
+
+    std::string res(offsets.back(), '\0');
+    pool.dispatch(blocks, [&](size_t begin, size_t end) {
+        for (auto b = begin; b < end; ++b) {
+            auto r = range(b);
+            SPRC_ write_span(res.data() + offsets[b], r.data(), r.size(), opt, b * block);
+        }
+    });
+    return res;
+}
 
 template <class T1, class T2>
 struct Formatter<std::pair<T1, T2>> {
@@ -552,16 +1679,18 @@ struct Formatter<std::pair<T1, T2>> {
                 break;
             }
     }
-    std::string operator()(const std::pair<T1, T2>& p) {
+    void format_to(format_buffer& buf, const std::pair<T1, T2>& p) const {
         switch (md) {
         case mode::key:
-            return _to_string(p.first);
+            format_arg(buf, {}, p.first);
             break;
         case mode::value:
-            return _to_string(p.second);
+            format_arg(buf, {}, p.second);
             break;
         default:
-            return FormatParser{"{}:{}"}(p.first, p.second);
+            format_arg(buf, {}, p.first);
+            buf.push_back(':');
+            format_arg(buf, {}, p.second);
             break;
         }
     }
@@ -579,33 +1708,70 @@ template <class T, class = void>
 struct is_iterable : std::false_type {};
 
 template <class T>
-struct is_iterable<T, typename std::iterator_traits<decltype(std::begin(std::declval<T&>()))>::value_type> : std::true_type {};
-
-template <class T>
-struct is_iterable<T, std::enable_if_t<std::is_pointer_v<decltype(std::begin(std::declval<T&>()))>>> : std::true_type {};
+struct is_iterable<T, std::void_t<decltype(std::begin(std::declval<const T&>())),
+                                  decltype(std::end(std::declval<const T&>()))>> : std::true_type {};
 
 template <class T>
 struct is_formatable_range {
     static constexpr bool value = !is_string<T>::value && is_iterable<T>::value;
 };
 
+/**
+ * spec: [n | brackets][separator][:element spec]
+ * `n` drops the brackets, brackets are one of `[]` `()` `<>`, the default is `{}`
+ * the separator is everything up to the first ':', the default is ", "
+ * e.g. {:n, } {:[]; :#x} {:n :.2}
+ */
 template <class T>
 struct Formatter<T, std::enable_if_t<is_formatable_range<T>::value>> {
-    Formatter(std::string_view){};
-    std::string operator()(const T& t){
-        std::string res = "{";
-        for (auto it = std::begin(t);;) {
-            res += _to_string(*it);
-            if (++it != std::end(t)) res += ", ";
-            else {res += '}'; break;}
+    using value_type = typename std::iterator_traits<decltype(std::begin(std::declval<const T&>()))>::value_type;
+
+    Formatter(std::string_view fmt) : elem(parse(fmt)) {}
+
+    void format_to(format_buffer& buf, const T& t) {
+        buf.append(open);
+        auto it = std::begin(t), end = std::end(t);
+        if (it != end) {
+            write(buf, *it);
+            while (++it != end) {
+                buf.append(sep);
+                write(buf, *it);
+            }
         }
-        return res;
+        buf.append(close);
+    }
+
+private:
+    std::string_view open = "{", close = "}", sep = ", ";
+    Formatter<value_type> elem;
+
+    std::string_view parse(std::string_view fmt) {
+        if (!fmt.empty() && fmt[0] == 'n') {
+            open = close = {};
+            fmt.remove_prefix(1);
+        } else if (fmt.size() >= 2 && (fmt.starts_with("[]") || fmt.starts_with("()") || fmt.starts_with("<>"))) {
+            open = fmt.substr(0, 1);
+            close = fmt.substr(1, 1);
+            fmt.remove_prefix(2);
+        }
+        auto colon = fmt.find(':');
+        if (colon != 0 && !fmt.empty())
+            sep = fmt.substr(0, colon);
+        return colon == fmt.npos ? std::string_view{} : fmt.substr(colon + 1);
+    }
+
+    void write(format_buffer& buf, const value_type& v) {
+        if constexpr (buffered_formatter<value_type>)
+            elem.format_to(buf, v);
+        else
+            buf.append(elem(v));
     }
 };
 
 #undef ST_CFUNC
+#undef SE_SIMD_AVX2
+#undef SE_SIMD_SSE2
 #undef __format_throw
 #undef SPRC_
-#undef _to_string
 
 }
\ No newline at end of file
@@ -12,10 +12,38 @@
 #include <fstream>
 #include <cassert>
 #include <source_location>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <ctime>
+#include <tuple>
+#include <utility>
+#include <functional>
+#include <vector>
+#include <cerrno>
+#include <filesystem>
+#include <algorithm>
 
-#include "seformat.h"
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 
-#define FMT st::format
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#elif defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#include "seformat.h"
 
 namespace st::log {
 
@@ -59,48 +87,1165 @@ constexpr const char* log_level_name(log_level lev) {
 #undef _func
 }
 
-namespace {
-std::ostream* op_stream = &std::cout;
+// the level name without colors, for machine readable output
+constexpr const char* log_level_str(log_level lev) {
+#define _func(x) case log_level:: x : return #x;
+    switch (lev) {
+    FOREACH_LOG_LEVEL(_func)
+    default:
+        assert(false && "Unkonw level!");
+    }
+#undef _func
+}
 
+/**
+ * levels below SELOG_ACTIVE_LEVEL are compiled out, e.g. -DSELOG_ACTIVE_LEVEL=info
+ * the *_LOG macros then do not even evaluate their arguments
+ */
+#ifndef SELOG_ACTIVE_LEVEL
+#define SELOG_ACTIVE_LEVEL trace
+#endif
+inline constexpr log_level active_level = log_level::SELOG_ACTIVE_LEVEL;
+
+// global variable, inline so every translation unit shares them
 #ifdef NDEGUG
-log_level min_lev = log_level::info;
+inline std::atomic<log_level> min_lev = log_level::info;
 #else 
-log_level min_lev = log_level::trace;
+inline std::atomic<log_level> min_lev = log_level::trace;
 #endif
 
-std::string time_format = "[ %x - %X ]:"; // dont support yet
-} // global variable
+/**
+ * strftime format of time_log, besides the usual fields
+ * %L, %f and %N print milliseconds, microseconds and nanoseconds
+ */
+inline std::string time_format = "[ %x - %X ]:";
+inline std::mutex time_format_mutex;
+inline std::atomic<uint32_t> time_format_version = 0;
 
 inline void set_min_Level(log_level min) {
-    min_lev = min;
+    min_lev.store(min, std::memory_order_relaxed);
 }
 inline log_level get_min_Level() {
-    return min_lev;
+    return min_lev.load(std::memory_order_relaxed);
+}
+
+inline bool enabled(log_level lev) {
+    return lev >= active_level && lev >= min_lev.load(std::memory_order_relaxed);
 }
 
 inline void set_time_format(const std::string& tfmt) {
+    std::lock_guard lock{time_format_mutex};
     time_format = tfmt;
+    time_format_version.fetch_add(1, std::memory_order_release);
+}
+
+/**
+ * where timestamps come from, all of them are reported as wall clock time
+ * monotonic never goes back, tsc reads the cycle counter calibrated against the
+ * system clock and is the cheapest for high rate logs (x86 only, monotonic elsewhere)
+ */
+enum class clock_source {
+    realtime,
+    monotonic,
+    tsc
+};
+
+struct clock_state {
+    std::atomic<clock_source> source = clock_source::realtime;
+    std::atomic<int64_t> base_ns = 0;    // wall clock at calibration
+    std::atomic<int64_t> base_ticks = 0; // source reading at calibration
+    std::atomic<double> ns_per_tick = 1;
+};
+inline clock_state log_clock;
+
+inline int64_t realtime_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline int64_t read_ticks(clock_source src) {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    if (src == clock_source::tsc)
+        return static_cast<int64_t>(__rdtsc());
+#endif
+    (void)src;
+    return monotonic_ns();
+}
+
+// call before other threads start logging
+inline void set_clock_source(clock_source src) {
+    double ns_per_tick = 1;
+    auto ticks = read_ticks(src);
+    auto ns = realtime_ns();
+    if (src == clock_source::tsc) {
+        auto mono = monotonic_ns();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        ns_per_tick = double(monotonic_ns() - mono) / double(read_ticks(src) - ticks);
+    }
+    log_clock.base_ns.store(ns, std::memory_order_relaxed);
+    log_clock.base_ticks.store(ticks, std::memory_order_relaxed);
+    log_clock.ns_per_tick.store(ns_per_tick, std::memory_order_relaxed);
+    log_clock.source.store(src, std::memory_order_release);
+}
+
+// nanoseconds since the epoch from the selected source
+inline int64_t log_clock_now() {
+    auto src = log_clock.source.load(std::memory_order_acquire);
+    if (src == clock_source::realtime)
+        return realtime_ns();
+    auto ticks = read_ticks(src) - log_clock.base_ticks.load(std::memory_order_relaxed);
+    return log_clock.base_ns.load(std::memory_order_relaxed)
+         + static_cast<int64_t>(ticks * log_clock.ns_per_tick.load(std::memory_order_relaxed));
+}
+
+/**
+ * one record on its way to the sinks, the views only live for the call
+ */
+struct log_record {
+    log_level lev = log_level::trace;
+    bool leveled = false;     // print_* and titled output have no level and reach every sink
+    std::string_view text;    // the record in the default layout, newline included
+    std::string_view message; // the formatted message inside `text`
+    std::string_view fields;  // JSON members of a structured record, e.g. "ms":1.5,"path":"/"
+    int64_t time = 0;         // set by structured records, ns of the log clock
+};
+
+// the record is `buf` from `begin` up to `end`, which excludes the line ending
+inline log_record make_record(const format_buffer& buf, size_t begin, size_t end,
+                              log_level lev = log_level::trace, bool leveled = false) {
+    auto text = buf.view();
+    return {lev, leveled, text, text.substr(begin, end - begin), {}, 0};
 }
 
+using record_layout = std::function<void(format_buffer&, const log_record&)>;
+
+// the default layout without ANSI colors
+inline void plain_layout(format_buffer& buf, const log_record& rec) {
+    auto text = rec.text;
+    for (size_t i = 0; i < text.size();) {
+        auto esc = text.find('\x1b', i);
+        buf.append(text.substr(i, esc - i));
+        if (esc == text.npos) break;
+        auto end = text.find('m', esc);
+        i = end == text.npos ? text.size() : end + 1;
+    }
+}
+
+// writes `str` as a quoted JSON string
+inline void write_json_string(format_buffer& buf, std::string_view str) {
+    buf.push_back('"');
+    size_t run = 0; // characters that need no escaping are appended in one go
+    for (size_t i = 0; i < str.size(); i++) {
+        auto c = static_cast<unsigned char>(str[i]);
+        if (c >= 0x20 && c != '"' && c != '\\' && c != 0x7f) continue;
+        buf.append(str.substr(run, i - run));
+        run = i + 1;
+        switch (c) {
+        case '"':  buf.append("\\\""); break;
+        case '\\': buf.append("\\\\"); break;
+        case '\n': buf.append("\\n"); break;
+        case '\r': buf.append("\\r"); break;
+        case '\t': buf.append("\\t"); break;
+        case '\b': buf.append("\\b"); break;
+        case '\f': buf.append("\\f"); break;
+        default:
+            buf.append("\\u00");
+            buf.push_back("0123456789abcdef"[c >> 4]);
+            buf.push_back("0123456789abcdef"[c & 15]);
+        }
+    }
+    buf.append(str.substr(run));
+    buf.push_back('"');
+}
+
+// JSON Lines: time (structured records only), level, msg and the fields of the record
+inline void json_layout(format_buffer& buf, const log_record& rec) {
+    buf.push_back('{');
+    if (rec.time)
+        format_to(buf, "\"time\":{},", rec.time);
+    if (rec.leveled) {
+        buf.append("\"level\":\"");
+        buf.append(log_level_str(rec.lev));
+        buf.append("\",");
+    }
+    buf.append("\"msg\":");
+    write_json_string(buf, rec.message);
+    if (!rec.fields.empty()) {
+        buf.push_back(',');
+        buf.append(rec.fields);
+    }
+    buf.append("}\n");
+}
+
+/**
+ * destination of records with its own level filter and layout
+ * implementations get complete records one at a time, never concurrently
+ */
+class sink {
+public:
+    virtual ~sink() = default;
+
+    void set_level(log_level lev) {min.store(lev, std::memory_order_relaxed);}
+    log_level level() const {return min.load(std::memory_order_relaxed);}
+
+    // set before the sink is added, an empty layout writes `text` as it is
+    void set_layout(record_layout f) {layout = std::move(f);}
+
+    void log(const log_record& rec) {
+        if (rec.leveled && rec.lev < level()) return;
+        if (!layout) return write(rec.text);
+        memory_buffer buf;
+        layout(buf, rec);
+        write(buf.view());
+    }
+
+    virtual void flush() {}
+
+    // called by the async backend after every batch and whenever it runs out of records
+    virtual void idle() {}
+
+protected:
+    virtual void write(std::string_view str) = 0;
+
+private:
+    std::atomic<log_level> min{log_level::trace};
+    record_layout layout;
+};
+
+class ostream_sink : public sink {
+public:
+    explicit ostream_sink(std::ostream& os) : os(os) {}
+
+    void flush() override {os.flush();}
+
+protected:
+    void write(std::string_view str) override {os.write(str.data(), str.size());}
+
+private:
+    std::ostream& os;
+};
+
+/**
+ * when a buffering sink hands its records to the system
+ * the interval is checked on every write and, with the async backend running, at
+ * least once a millisecond by the backend; without it nothing looks at the clock
+ * between writes, call flush() after the last record that must not wait
+ */
+struct flush_policy {
+    size_t every = 0; // records between flushes, 1 flushes each record, 0 waits for a full buffer
+    std::chrono::milliseconds interval{0}; // flush once the oldest buffered record is this old
+};
+
+/**
+ * appends through an O_APPEND descriptor, records gather in a userspace buffer
+ * and one writev sends it together with a record that does not fit anymore
+ */
+class file_sink : public sink {
+public:
+    explicit file_sink(const std::string& path, flush_policy policy = {}, size_t buffer_size = 1 << 16)
+    : fd(open_append(path)), policy(policy), buf(std::max<size_t>(buffer_size, 1)) {
+        if (fd < 0)
+            throw std::runtime_error("failed to open log file: " + path);
+    }
+
+    ~file_sink() override {
+        flush();
+        close_fd(fd);
+    }
+
+    void flush() override {write_out({});}
+
+    void idle() override {
+        if (size && due()) flush();
+    }
+
+protected:
+    void write(std::string_view str) override {
+        if (size == 0) first = std::chrono::steady_clock::now();
+        if (size + str.size() > buf.size()) {
+            write_out(str);
+        } else {
+            std::memcpy(buf.data() + size, str.data(), str.size());
+            size += str.size();
+            ++pending;
+        }
+        if ((policy.every && pending >= policy.every) || due())
+            flush();
+    }
+
+    static int open_append(const std::string& path, bool truncate = false) {
+#ifdef _WIN32
+        return ::_open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (truncate ? _O_TRUNC : 0), 0644);
+#else
+        return ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (truncate ? O_TRUNC : 0), 0644);
+#endif
+    }
+
+    static void close_fd(int fd) {
+#ifdef _WIN32
+        ::_close(fd);
+#else
+        ::close(fd);
+#endif
+    }
+
+    int fd;
+
+private:
+    bool due() const {
+        return policy.interval.count() && std::chrono::steady_clock::now() - first >= policy.interval;
+    }
+
+    void write_out(std::string_view extra) {
+        write_fully({buf.data(), size}, extra);
+        size = pending = 0;
+    }
+
+    void write_fully(std::string_view a, std::string_view b) {
+#ifdef _WIN32
+        for (auto str : {a, b})
+            while (!str.empty()) {
+                auto n = ::_write(fd, str.data(), static_cast<unsigned>(str.size()));
+                if (n < 0) return; // nowhere left to report it
+                str.remove_prefix(n);
+            }
+#else
+        iovec iov[2] = {{const_cast<char*>(a.data()), a.size()}, {const_cast<char*>(b.data()), b.size()}};
+        iovec* v = iov;
+        int count = 2;
+        while (count > 0) {
+            auto n = ::writev(fd, v, count);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return; // nowhere left to report it
+            }
+            for (; count > 0 && static_cast<size_t>(n) >= v->iov_len; ++v, --count)
+                n -= v->iov_len;
+            if (count > 0) {
+                v->iov_base = static_cast<char*>(v->iov_base) + n;
+                v->iov_len -= n;
+            }
+        }
+#endif
+    }
+
+    flush_policy policy;
+    std::vector<char> buf;
+    size_t size = 0, pending = 0;
+    std::chrono::steady_clock::time_point first;
+};
+
+struct rotation_policy {
+    size_t max_size = 0;              // bytes per file, 0 for no limit
+    std::chrono::seconds interval{0}; // also roll over at multiples of this since the epoch, 0 never
+    size_t keep = 5;                  // old files kept as path.1 (newest) to path.keep
+};
+
+/**
+ * file_sink that rolls over by size or time, the next file is opened and
+ * preallocated ahead of time and every rename happens on a background thread,
+ * the logging path only swaps descriptors
+ */
+class rotating_file_sink : public file_sink {
+public:
+    rotating_file_sink(const std::string& path, rotation_policy rotation,
+                       flush_policy policy = {}, size_t buffer_size = 1 << 16)
+    : file_sink(path, policy, buffer_size), path(path), rotation(rotation) {
+        written = file_size(fd);
+        next_time = next_rotation();
+        worker = std::thread{[this] {run();}};
+    }
+
+    ~rotating_file_sink() override {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        cv.notify_one();
+        worker.join();
+        if (prepared >= 0) {
+            close_fd(prepared);
+            std::error_code ec;
+            std::filesystem::remove(path + ".next", ec);
+        }
+    }
+
+protected:
+    void write(std::string_view str) override {
+        if (due(str.size())) rotate();
+        written += str.size();
+        file_sink::write(str);
+    }
+
+private:
+    bool due(size_t n) const {
+        if (rotation.max_size && written && written + n > rotation.max_size) return true;
+        return rotation.interval.count() && std::chrono::system_clock::now() >= next_time;
+    }
+
+    std::chrono::system_clock::time_point next_rotation() const {
+        if (!rotation.interval.count()) return {};
+        auto now = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::system_clock::time_point{(now / rotation.interval + 1) * rotation.interval};
+    }
+
+    // keeps writing to the current file until the worker has the next one ready
+    void rotate() {
+        int next;
+        {
+            std::lock_guard lock{mutex};
+            if (prepared < 0 || retired >= 0) return;
+            next = std::exchange(prepared, -1);
+        }
+        flush();
+        {
+            std::lock_guard lock{mutex};
+            retired = std::exchange(fd, next);
+        }
+        cv.notify_one();
+        written = 0;
+        next_time = next_rotation();
+    }
+
+    void run() {
+        std::unique_lock lock{mutex};
+        for (;;) {
+            cv.wait(lock, [&] {return stopping || prepared < 0 || retired >= 0;});
+            if (retired >= 0) { // finished even when stopping, the names must be right
+                int old = retired;
+                lock.unlock();
+                close_fd(old);
+                shift_files();
+                lock.lock();
+                retired = -1;
+            }
+            if (stopping) return;
+            if (prepared < 0) {
+                lock.unlock();
+                int next = prepare();
+                lock.lock();
+                prepared = next;
+                if (next < 0) { // retried on the next rotation
+                    cv.wait_for(lock, std::chrono::seconds(1), [&] {return stopping;});
+                }
+            }
+        }
+    }
+
+    // path -> path.1 -> ... -> path.keep, then the prepared file becomes path
+    void shift_files() {
+        std::error_code ec;
+        auto name = [&](size_t i) {return i ? path + '.' + std::to_string(i) : path;};
+        if (rotation.keep == 0) {
+            std::filesystem::remove(path, ec);
+        } else {
+            for (auto i = rotation.keep; i > 0; --i)
+                std::filesystem::rename(name(i - 1), name(i), ec);
+        }
+        std::filesystem::rename(path + ".next", path, ec);
+    }
+
+    int prepare() {
+        int next = open_append(path + ".next", true);
+#if defined(__linux__)
+        if (next >= 0 && rotation.max_size) // blocks are reserved, the size still grows with each append
+            ::fallocate(next, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(rotation.max_size));
+#endif
+        return next;
+    }
+
+    static size_t file_size(int fd) {
+#ifdef _WIN32
+        return static_cast<size_t>(::_lseeki64(fd, 0, SEEK_END));
+#else
+        struct stat st;
+        return ::fstat(fd, &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+#endif
+    }
+
+    std::string path;
+    rotation_policy rotation;
+    size_t written = 0;
+    std::chrono::system_clock::time_point next_time;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable cv;
+    int prepared = -1, retired = -1; // handed between the logging path and the worker
+    bool stopping = false;
+};
+
+/**
+ * layout of a flight recorder file, a header followed by a ring of records
+ * each stored as [u32 size][text][u32 size] so readers can walk back from `end`
+ */
+struct flight_header {
+    char magic[8];     // "SEFLIGHT"
+    uint64_t capacity; // bytes in the ring
+    uint64_t begin;    // bytes reserved so far, a record past `end` was being written
+    uint64_t end;      // bytes completely written so far
+    char pad[32];
+};
+inline constexpr char flight_magic[8] = {'S', 'E', 'F', 'L', 'I', 'G', 'H', 'T'};
+
+// the last `n` complete records of a flight recorder file image, oldest first
+inline std::vector<std::string> flight_records(std::string_view image, size_t n = SIZE_MAX) {
+    std::vector<std::string> res;
+    flight_header h;
+    if (image.size() < sizeof(h)) return res;
+    std::memcpy(&h, image.data(), sizeof(h));
+    if (std::memcmp(h.magic, flight_magic, sizeof(flight_magic)) != 0 ||
+        h.capacity == 0 || image.size() < sizeof(h) + h.capacity) return res;
+
+    auto ring = image.data() + sizeof(h);
+    auto read = [&](uint64_t pos, char* out, size_t size) {
+        for (size_t i = 0; i < size; ++i)
+            out[i] = ring[(pos + i) % h.capacity];
+    };
+    // whatever the unfinished record overwrote is gone
+    auto lowest = std::max(h.begin, h.end) > h.capacity ? std::max(h.begin, h.end) - h.capacity : 0;
+    for (auto end = h.end; res.size() < n && end >= lowest + 8;) {
+        uint32_t size, check;
+        read(end - 4, reinterpret_cast<char*>(&size), 4);
+        if (end - lowest < size + 8ull) break;
+        auto begin = end - 8 - size;
+        read(begin, reinterpret_cast<char*>(&check), 4);
+        if (check != size) break;
+        auto& str = res.emplace_back(size, '\0');
+        read(begin + 4, str.data(), size);
+        end = begin;
+    }
+    std::reverse(res.begin(), res.end());
+    return res;
+}
+
+#ifndef _WIN32
+/**
+ * keeps the most recent records in a memory mapped file, the page cache
+ * still has them after a crash, writing is a memcpy and a bump of `end`
+ * read them back with flight_records or sample/flight.cc
+ */
+class flight_recorder_sink : public sink {
+public:
+    explicit flight_recorder_sink(const std::string& path, size_t capacity = 1 << 22) {
+        // a record is its size twice around the text, at least one byte of it must fit
+        if (capacity < 8 + 1)
+            throw std::invalid_argument("flight recorder capacity too small: " + std::to_string(capacity));
+        set_layout(plain_layout);
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw std::runtime_error("failed to open flight recorder: " + path);
+        size = sizeof(flight_header) + capacity;
+        struct stat st;
+        bool reuse = ::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) == size;
+        if (!reuse && ::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("failed to size flight recorder: " + path);
+        }
+        auto p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+            throw std::runtime_error("failed to map flight recorder: " + path);
+        map = static_cast<char*>(p);
+        header = reinterpret_cast<flight_header*>(map);
+        // an existing recording of the same size is continued
+        if (!reuse || std::memcmp(header->magic, flight_magic, sizeof(flight_magic)) != 0 ||
+            header->capacity != capacity) {
+            std::memset(header, 0, sizeof(flight_header));
+            header->capacity = capacity;
+            std::memcpy(header->magic, flight_magic, sizeof(flight_magic));
+        }
+        header->begin = header->end; // drop a record a crash left unfinished
+    }
+
+    ~flight_recorder_sink() override {
+        ::munmap(map, size);
+    }
+
+    void flush() override {
+        ::msync(map, size, MS_ASYNC);
+    }
+
+protected:
+    void write(std::string_view str) override {
+        const auto capacity = header->capacity;
+        if (str.size() + 8 > capacity) str = str.substr(0, capacity - 8);
+        auto size = static_cast<uint32_t>(str.size());
+        auto pos = header->end;
+        std::atomic_ref<uint64_t>{header->begin}.store(pos + size + 8, std::memory_order_relaxed);
+        copy(pos, &size, 4);
+        copy(pos + 4, str.data(), size);
+        copy(pos + 4 + size, &size, 4);
+        std::atomic_ref<uint64_t>{header->end}.store(pos + size + 8, std::memory_order_release);
+    }
+
+private:
+    void copy(uint64_t pos, const void* src, size_t n) {
+        auto ring = map + sizeof(flight_header);
+        auto off = pos % header->capacity;
+        auto first = std::min<size_t>(n, header->capacity - off);
+        std::memcpy(ring + off, src, first);
+        std::memcpy(ring, static_cast<const char*>(src) + first, n - first);
+    }
+
+    char* map = nullptr;
+    flight_header* header = nullptr;
+    size_t size = 0;
+};
+#endif
+
+inline std::vector<std::shared_ptr<sink>> sinks{std::make_shared<ostream_sink>(std::cout)};
+inline std::mutex sinks_mutex; // held while a record is handed to the sinks, so records never interleave
+
+inline void dispatch(const log_record& rec) {
+    std::lock_guard lock{sinks_mutex};
+    for (auto& s : sinks)
+        s->log(rec);
+}
+
+inline void flush_sinks() {
+    std::lock_guard lock{sinks_mutex};
+    for (auto& s : sinks)
+        s->flush();
+}
+
+/**
+ * bounded multi-producer single-consumer ring of variable sized records
+ * producers reserve space with a CAS on `head`, a record becomes visible to the
+ * consumer once its header is published and the consumer hands the space back
+ * by zeroing it and moving `tail`
+ */
+class record_ring {
+public:
+    explicit record_ring(size_t size)
+    : cap(std::bit_ceil(std::max<size_t>(size, 64))), mask(cap - 1),
+      words(std::make_unique<uint64_t[]>(cap / 8)) {}
+
+    size_t capacity() const {return cap;}
+
+    /**
+     * reserves `n` bytes and fills them through `write(char*)`
+     * returns false when the ring is full or the record can never fit
+     */
+    template <class F>
+    bool try_push(size_t n, F&& write) {
+        const size_t need = record_size(n);
+        if (need > cap) return false;
+        uint64_t pos = head.load(std::memory_order_relaxed);
+        size_t pad;
+        for (;;) {
+            auto off = pos & mask;
+            pad = off + need > cap ? cap - off : 0; // records never wrap around
+            auto limit = tail.load(std::memory_order_acquire) + cap;
+            if (pos + pad + need <= limit) {
+                if (head.compare_exchange_weak(pos, pos + pad + need,
+                                               std::memory_order_acq_rel, std::memory_order_relaxed))
+                    break;
+                continue;
+            }
+            // a big record may never fit before the end of the lap, pad it out on its own
+            // so the record starts at offset 0 once the consumer makes room
+            if (pad == 0 || pos + pad > limit)
+                return false;
+            if (head.compare_exchange_weak(pos, pos + pad, std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                publish(off, pad_flag | static_cast<uint32_t>(pad));
+                pos += pad;
+            }
+        }
+        if (pad) {
+            publish(pos & mask, pad_flag | static_cast<uint32_t>(pad));
+            pos += pad;
+        }
+        write(data() + (pos & mask) + header_size);
+        publish(pos & mask, static_cast<uint32_t>(n) + 1);
+        return true;
+    }
+
+    /**
+     * hands every published record to `f(const char*, size_t)` in order, at most `max`
+     * returns the number of records consumed
+     */
+    template <class F>
+    size_t consume(F&& f, size_t max = SIZE_MAX) {
+        size_t count = 0;
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        while (count < max) {
+            auto off = pos & mask;
+            auto h = std::atomic_ref<uint32_t>{header(off)}.load(std::memory_order_acquire);
+            if (h == 0) break;
+            size_t size;
+            if (h & pad_flag) {
+                size = h & ~pad_flag;
+            } else {
+                size = record_size(h - 1);
+                f(static_cast<const char*>(data() + off + header_size), size_t{h - 1});
+                ++count;
+            }
+            std::memset(data() + off, 0, size);
+            pos += size;
+            tail.store(pos, std::memory_order_release);
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    // positions in bytes since the start, a record pushed before reading head() is consumed once tail() passes it
+    uint64_t head_position() const {return head.load(std::memory_order_acquire);}
+    uint64_t tail_position() const {return tail.load(std::memory_order_acquire);}
+
+    // bytes reserved by producers and not yet consumed
+    size_t used() const {
+        auto t = tail.load(std::memory_order_acquire); // first, so it can not pass the head
+        return std::min<size_t>(head.load(std::memory_order_acquire) - t, cap);
+    }
+
+private:
+    static constexpr size_t header_size = 8;
+    static constexpr uint32_t pad_flag = 1u << 31;
+
+    static constexpr size_t record_size(size_t n) {
+        return (header_size + n + 7) & ~size_t{7};
+    }
+
+    char* data() {return reinterpret_cast<char*>(words.get());}
+    uint32_t& header(size_t off) {return *reinterpret_cast<uint32_t*>(data() + off);}
+
+    void publish(size_t off, uint32_t h) {
+        std::atomic_ref<uint32_t>{header(off)}.store(h, std::memory_order_release);
+    }
+
+    const size_t cap, mask;
+    std::unique_ptr<uint64_t[]> words;
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+};
+
+/**
+ * a record in the queue starts with the function that turns the rest of it
+ * into a log_record, `buf` holds the text if it has to be rendered first
+ */
+using record_decoder = log_record (*)(format_buffer& buf, const char* data, size_t size);
+
+struct text_header {
+    log_level lev;
+    bool leveled;
+    uint32_t begin, end; // the message inside the text
+    uint32_t fields;     // size of the fields that follow the text
+    int64_t time;
+};
+
+inline log_record decode_text(format_buffer&, const char* data, size_t size) {
+    text_header h;
+    std::memcpy(&h, data, sizeof(h));
+    std::string_view text{data + sizeof(h), size - sizeof(h) - h.fields};
+    std::string_view fields{text.data() + text.size(), h.fields};
+    return {h.lev, h.leveled, text, text.substr(h.begin, h.end - h.begin), fields, h.time};
+}
+
+/**
+ * binary output of the *_LOG sites, declared ahead of the backend so they outlive it:
+ * a backend destroyed at exit still drains its queued binary records into them
+ */
+class binary_log;
+struct binary_log_deleter {
+    void operator()(binary_log* out) const;
+};
+inline std::unique_ptr<binary_log, binary_log_deleter> binary_out;
+inline std::mutex binary_mutex;
+inline std::atomic<bool> binary_active = false;
+
+inline void flush_binary();
+
+/**
+ * what a producer does when the queue is full, latency against completeness
+ *   block             wait for the backend, nothing is lost
+ *   drop_newest       discard the record being logged, the caller never waits
+ *   overwrite_oldest  discard the oldest queued records to make room
+ *   grow              queue the overflow on the heap, memory use is unbounded
+ */
+enum class overflow_policy {block, drop_newest, overwrite_oldest, grow};
+
+struct queue_stats {
+    uint64_t dropped = 0;  // records lost to drop_newest or overwrite_oldest
+    uint64_t blocked = 0;  // records whose producer had to wait for room
+    size_t high_water = 0; // most bytes queued at once, the heap overflow included
+    size_t capacity = 0;   // size of the ring in bytes
+};
+
+/**
+ * owns the ring and the thread that drains it into the sinks
+ */
+class async_backend {
+public:
+    ~async_backend() {stop();} // flush on exit
+
+    void start(size_t queue_size, overflow_policy overflow, std::chrono::milliseconds report) {
+        stop();
+        ring = std::make_unique<record_ring>(queue_size);
+        capacity = ring->capacity();
+        policy = overflow;
+        report_interval = report;
+        dropped = blocked = 0;
+        high_water = 0;
+        running.store(true, std::memory_order_release);
+        worker = std::thread{[this] {run();}};
+    }
+
+    void stop() {
+        if (!worker.joinable()) return;
+        running.store(false, std::memory_order_release);
+        cv.notify_one();
+        worker.join();
+        ring.reset();
+    }
+
+    bool active() const {
+        return running.load(std::memory_order_acquire);
+    }
+
+    /**
+     * pushes a record decoded by `decode` with `n` bytes filled by `write(char*)`
+     * a full queue is handled by the overflow policy, false if the record can never fit
+     * a fatal record is never dropped, it waits for room when the policy would drop it
+     */
+    template <class F>
+    bool push(record_decoder decode, size_t n, F&& write, log_level lev) {
+        const size_t size = sizeof(record_decoder) + n;
+        if (size + 8 > ring->capacity()) return false;
+        auto fill = [&](char* p) {
+            std::memcpy(p, &decode, sizeof(decode));
+            write(p + sizeof(decode));
+        };
+        // once records overflow to the heap the rest follow them to keep the order
+        if (!spilling.load(std::memory_order_acquire) && ring->try_push(size, fill))
+            return note_usage(ring->used()), true;
+
+        switch (lev == log_level::fatal && policy == overflow_policy::drop_newest ? overflow_policy::block : policy) {
+        case overflow_policy::block:
+            blocked.fetch_add(1, std::memory_order_relaxed);
+            while (!ring->try_push(size, fill)) {
+                cv.notify_one(); // the backend may be idling on a timeout
+                std::this_thread::yield();
+            }
+            break;
+        case overflow_policy::drop_newest:
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            cv.notify_one();
+            return true;
+        case overflow_policy::overwrite_oldest:
+            while (!ring->try_push(size, fill)) {
+                std::lock_guard lock{consume_mutex};
+                dropped.fetch_add(ring->consume([](const char*, size_t) {}, 1), std::memory_order_relaxed);
+            }
+            cv.notify_one();
+            break;
+        case overflow_policy::grow: {
+            std::string rec(size, '\0');
+            fill(rec.data());
+            std::lock_guard lock{spill_mutex};
+            spill_bytes += size;
+            spill.push_back(std::move(rec));
+            spilling.store(true, std::memory_order_release);
+            note_usage(ring->used() + spill_bytes);
+            cv.notify_one();
+            return true;
+        }
+        }
+        note_usage(ring->used());
+        return true;
+    }
+
+    queue_stats stats() const {
+        return {dropped.load(std::memory_order_relaxed), blocked.load(std::memory_order_relaxed),
+                high_water.load(std::memory_order_relaxed), capacity};
+    }
+
+    void push(const log_record& rec) {
+        text_header h{rec.lev, rec.leveled,
+                      static_cast<uint32_t>(rec.message.data() - rec.text.data()),
+                      static_cast<uint32_t>(rec.message.data() + rec.message.size() - rec.text.data()),
+                      static_cast<uint32_t>(rec.fields.size()), rec.time};
+        auto fits = push(decode_text, sizeof(h) + rec.text.size() + rec.fields.size(), [&](char* p) {
+            std::memcpy(p, &h, sizeof(h));
+            std::memcpy(p + sizeof(h), rec.text.data(), rec.text.size());
+            std::memcpy(p + sizeof(h) + rec.text.size(), rec.fields.data(), rec.fields.size());
+        }, rec.lev);
+        if (!fits) {
+            flush();
+            dispatch(rec);
+        }
+    }
+
+    // returns once everything pushed before the call is written and flushed
+    void flush() {
+        if (!active()) return;
+        auto ticket = flush_requested.fetch_add(1, std::memory_order_acq_rel) + 1;
+        cv.notify_one();
+        std::unique_lock lock{mutex};
+        done_cv.wait(lock, [&] {return flush_done >= ticket || !active();});
+    }
+
+private:
+    void note_usage(size_t bytes) {
+        auto top = high_water.load(std::memory_order_relaxed);
+        while (bytes > top && !high_water.compare_exchange_weak(top, bytes, std::memory_order_relaxed)) {}
+    }
+
+    // the overflow, empty once the backend has caught up
+    void take_spill(std::vector<std::string>& out) {
+        std::lock_guard lock{spill_mutex};
+        if (spill.empty()) {
+            spilling.store(false, std::memory_order_release);
+        } else {
+            out.swap(spill);
+            spill_bytes = 0;
+        }
+    }
+
+    // a warning through the sinks whenever records were dropped or blocked since the last one
+    void report(memory_buffer& buf, queue_stats& last) {
+        auto now = stats();
+        if (now.dropped == last.dropped && now.blocked == last.blocked) return;
+        buf.clear();
+        buf.push_back('[');
+        buf.append(log_level_name(log_level::warning));
+        buf.append("]: ");
+        auto begin = buf.size();
+        format_to(buf, "selog queue full: {} records dropped, {} blocked, high water {} of {} bytes",
+                  now.dropped - last.dropped, now.blocked - last.blocked, now.high_water, now.capacity);
+        auto end = buf.size();
+        buf.push_back('\n');
+        auto rec = make_record(buf, begin, end, log_level::warning, true);
+        for (auto& s : sinks)
+            s->log(rec);
+        last = now;
+    }
+
+    void run() {
+        // bounded so reports come around while producers keep the ring busy, flushes drain further
+        constexpr size_t batch_size = 1024;
+        memory_buffer buf;
+        std::string batch;
+        std::vector<std::string> spilled;
+        queue_stats reported;
+        auto next_report = std::chrono::steady_clock::now() + report_interval;
+        uint64_t done = 0;
+        auto handle = [&](const char* p, size_t size) {
+            record_decoder decode;
+            std::memcpy(&decode, p, sizeof(decode));
+            buf.clear();
+            auto rec = decode(buf, p + sizeof(decode), size - sizeof(decode));
+            if (rec.text.empty()) return; // handled by the decoder, e.g. binary output
+            for (auto& s : sinks)
+                s->log(rec);
+        };
+        // one batch from the ring to the sinks
+        auto pass = [&] {
+            size_t n = 0;
+            if (policy == overflow_policy::overwrite_oldest) {
+                // producers discard from the ring too, copy the records out and let go of it
+                batch.clear();
+                std::lock_guard lock{consume_mutex};
+                ring->consume([&](const char* p, size_t size) {
+                    batch.append(reinterpret_cast<const char*>(&size), sizeof(size));
+                    batch.append(p, size);
+                }, batch_size);
+            }
+            std::lock_guard lock{sinks_mutex};
+            if (policy == overflow_policy::overwrite_oldest) {
+                for (size_t i = 0, size; i < batch.size(); i += sizeof(size) + size, ++n) {
+                    std::memcpy(&size, batch.data() + i, sizeof(size));
+                    handle(batch.data() + i + sizeof(size), size);
+                }
+            } else {
+                n = ring->consume(handle, batch_size);
+            }
+            return n;
+        };
+        // batches until the tail reaches `target`, records still being written are waited for
+        auto drain_to = [&](uint64_t target) {
+            size_t n = 0;
+            while (ring->tail_position() < target) {
+                auto k = pass();
+                if (k == 0) std::this_thread::yield();
+                n += k;
+            }
+            return n;
+        };
+        for (;;) {
+            // read the ticket first, everything pushed before it is drained below
+            auto req = flush_requested.load(std::memory_order_acquire);
+            bool stopping = !running.load(std::memory_order_acquire);
+            size_t n = req != done ? drain_to(ring->head_position()) : pass();
+            if (spilling.load(std::memory_order_acquire)) {
+                // the overflow is newer than anything in the ring, which goes first
+                n += drain_to(ring->head_position());
+                spilled.clear();
+                take_spill(spilled);
+                std::lock_guard lock{sinks_mutex};
+                for (auto& r : spilled)
+                    handle(r.data(), r.size());
+                n += spilled.size();
+            }
+            {
+                std::lock_guard lock{sinks_mutex};
+                if (report_interval.count() > 0 && std::chrono::steady_clock::now() >= next_report) {
+                    report(buf, reported);
+                    next_report = std::chrono::steady_clock::now() + report_interval;
+                }
+                // idle after busy batches too, a sink filtering out every record never sees a write
+                for (auto& s : sinks) {
+                    if (req != done || (n && stopping))
+                        s->flush();
+                    else
+                        s->idle();
+                }
+                if (req != done || (n && stopping))
+                    flush_binary();
+            }
+            if (req != done) {
+                std::lock_guard lock{mutex};
+                flush_done = done = req;
+                done_cv.notify_all();
+            }
+            if (stopping && ring->empty() && !spilling.load(std::memory_order_acquire)) break;
+            if (n == 0) {
+                std::unique_lock lock{mutex};
+                cv.wait_for(lock, std::chrono::milliseconds(1), [&] {
+                    return !ring->empty() || spilling.load(std::memory_order_relaxed)
+                        || flush_requested.load(std::memory_order_relaxed) != done
+                        || !running.load(std::memory_order_relaxed);
+                });
+            }
+        }
+        if (report_interval.count() > 0) {
+            std::lock_guard lock{sinks_mutex};
+            report(buf, reported);
+        }
+        flush_sinks();
+        flush_binary();
+        std::lock_guard lock{mutex};
+        flush_done = flush_requested.load();
+        done_cv.notify_all();
+    }
+
+    std::unique_ptr<record_ring> ring;
+    size_t capacity = 0;
+    overflow_policy policy = overflow_policy::block;
+    std::chrono::milliseconds report_interval{0};
+    std::atomic<uint64_t> dropped{0}, blocked{0};
+    std::atomic<size_t> high_water{0};
+    std::mutex consume_mutex; // overwrite_oldest, producers consume too
+    std::mutex spill_mutex;   // grow
+    std::vector<std::string> spill;
+    size_t spill_bytes = 0;
+    std::atomic<bool> spilling{false};
+    std::thread worker;
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> flush_requested{0};
+    uint64_t flush_done = 0;
+    std::mutex mutex;
+    std::condition_variable cv, done_cv;
+};
+
+inline async_backend backend;
+
+/**
+ * records are handed to a background thread instead of being written by the caller
+ * `queue_size` is the size of the ring in bytes, rounded up to a power of two
+ * `overflow` decides what happens when it is full, drops and waits are logged as a
+ * warning every `report` if there were any, 0 turns that off
+ * call before other threads start logging, stop_async after they are done
+ */
+inline void start_async(size_t queue_size = 1 << 20, overflow_policy overflow = overflow_policy::block,
+                        std::chrono::milliseconds report = std::chrono::seconds(10)) {
+    flush_sinks();
+    backend.start(queue_size, overflow, report);
+}
+
+inline void stop_async() {
+    backend.stop();
+}
+
+// counters of the current or last async run
+inline queue_stats async_stats() {
+    return backend.stats();
+}
+
+// everything logged so far has reached the sinks and the sinks are flushed
+inline void flush() {
+    if (backend.active()) {
+        backend.flush();
+    } else {
+        flush_sinks();
+        flush_binary();
+    }
+}
+
+// every complete record goes through here
+inline void write_record(const log_record& rec) {
+    if (backend.active())
+        backend.push(rec);
+    else
+        dispatch(rec);
+}
+
+/**
+ * the sink registry, changes are safe while other threads are logging
+ * records logged before a change reach the old sinks
+ */
+inline void set_sinks(std::vector<std::shared_ptr<sink>> list) {
+    flush();
+    std::lock_guard lock{sinks_mutex};
+    sinks.swap(list);
+} // the old sinks flush and close here, outside the lock
+
+inline void add_sink(std::shared_ptr<sink> s) {
+    std::lock_guard lock{sinks_mutex};
+    sinks.push_back(std::move(s));
+}
+
+inline void remove_sink(const std::shared_ptr<sink>& s) {
+    flush();
+    std::lock_guard lock{sinks_mutex};
+    std::erase(sinks, s);
+}
+
+// the only sink is then `filename`, or stdout
 inline void open_file(const std::string& filename) {
-    if (op_stream != &std::cout) delete op_stream;
-    op_stream = new std::ofstream(filename, std::ios::app);
+    set_sinks({std::make_shared<file_sink>(filename)});
 }
 
 inline void use_stdout() {
-    if (op_stream == &std::cout) return;
-    delete op_stream;
-    op_stream = &std::cout;
+    set_sinks({std::make_shared<ostream_sink>(std::cout)});
 }
 
 struct printer {
     constexpr printer(const char* el) : el(el) {}
     template <class...Args>
-    void operator()(std::string_view fmt, Args...args) const {
-        (*op_stream) << FMT(fmt, std::forward<Args>(args)...) << el;
+    void operator()(std::string_view fmt, const Args&...args) const {
+        vprint(fmt, make_format_args(args...));
     }
     void operator()(std::string_view str) const {
-        (*op_stream) << str << el;
+        memory_buffer buf;
+        buf.append(str);
+        buf.append(el);
+        write_record(make_record(buf, 0, str.size()));
+    }
+    void vprint(std::string_view fmt, format_args args) const {
+        memory_buffer buf;
+        vformat_to(buf, fmt, args);
+        auto end = buf.size();
+        buf.append(el);
+        write_record(make_record(buf, 0, end));
     }
     const char* el;
 };
@@ -111,8 +1256,8 @@ constexpr printer print_tab{"\n\t"};
 template <class T>
 struct with_source_localtion {
     template <class U, 
-              class = std::enable_if_t<std::is_constructible_v<T, U>>>
-    constexpr with_source_localtion(U inner, std::source_location loc = std::source_location::current())
+              class = std::enable_if_t<std::is_constructible_v<T, U&&>>>
+    constexpr with_source_localtion(U&& inner, std::source_location loc = std::source_location::current())
     : inner(std::forward<U>(inner)), location(loc) {}
 
     constexpr T& get() {return inner;}
@@ -122,64 +1267,814 @@ struct with_source_localtion {
     std::source_location location;
 };
 
+/**
+ * a format string known to outlive every record, e.g. static_fmt{"done in {}ms"}
+ * only constants qualify, a buffer on the stack does not compile
+ */
+struct static_fmt {
+    template <size_t N>
+    consteval static_fmt(const char (&str)[N]) : str(str, std::char_traits<char>::length(str)) {}
+
+    std::string_view str;
+};
+
+/**
+ * format string of a log call, deferred records copy it unless it is a static_fmt,
+ * then they keep a pointer; char arrays are read up to their terminator
+ */
+struct log_fmt {
+    constexpr log_fmt(static_fmt fmt) : str(fmt.str), is_static(true) {}
+    template <class S, class = std::enable_if_t<std::is_convertible_v<const S&, std::string_view>>>
+    constexpr log_fmt(const S& str) : str(str) {}
+
+    std::string_view str;
+    bool is_static = false;
+};
+
+/**
+ * the v* functions do the work, the variadic templates only pack their arguments
+ * each record is assembled in one buffer and written at once
+ */
+// returns where the message starts, it ends right before the newline
+inline size_t format_titled(format_buffer& buf, std::string_view title, std::string_view fmt, format_args args) {
+    buf.push_back('[');
+    buf.append(title);
+    buf.append("]: ");
+    auto begin = buf.size();
+    vformat_to(buf, fmt, args);
+    buf.push_back('\n');
+    return begin;
+}
+
+inline void format_location(format_buffer& buf, const std::source_location& loc) {
+    format_to(buf, "{}:{} in {}:\n\t", loc.file_name(), loc.line(), loc.function_name());
+}
+
+/**
+ * time_format split at its sub-second fields, the strftime parts are
+ * rendered once per second and reused, each thread keeps its own cache
+ */
+class time_formatter {
+public:
+    void format(format_buffer& buf, int64_t ns) {
+        auto version = time_format_version.load(std::memory_order_acquire);
+        if (version != compiled_version || parts.empty()) {
+            std::lock_guard lock{time_format_mutex};
+            compile(time_format);
+            compiled_version = version;
+            cached_sec = INT64_MIN;
+        }
+        auto sec = ns / 1000000000, sub = ns % 1000000000;
+        if (sub < 0) --sec, sub += 1000000000;
+        if (sec != cached_sec) render(sec);
+        for (auto& p : parts) {
+            if (p.digits == 0) {
+                buf.append(p.text);
+                continue;
+            }
+            char digits[10]; // a leading 1 keeps the zeros
+            str_process::write_decimal(digits + 10, static_cast<uint32_t>(sub) + 1000000000u);
+            buf.append(digits + 1, digits + 1 + p.digits);
+        }
+    }
+
+private:
+    struct part {
+        std::string fmt, text; // text is fmt rendered for cached_sec
+        int digits = 0;        // sub-second digits, the part has no text then
+    };
+
+    void compile(std::string_view fmt) {
+        parts.clear();
+        parts.emplace_back();
+        for (size_t i = 0; i < fmt.size(); ++i) {
+            int digits = 0;
+            if (fmt[i] == '%' && i + 1 < fmt.size()) {
+                switch (fmt[i + 1]) {
+                case 'L': digits = 3; break;
+                case 'f': digits = 6; break;
+                case 'N': digits = 9; break;
+                default:
+                    parts.back().fmt += fmt.substr(i, 2); // keeps %% together
+                    ++i;
+                    continue;
+                }
+            }
+            if (digits == 0) {
+                parts.back().fmt += fmt[i];
+                continue;
+            }
+            parts.push_back({{}, {}, digits});
+            parts.emplace_back();
+            ++i;
+        }
+    }
+
+    void render(int64_t sec) {
+        std::time_t t = sec;
+        std::tm tm;
+#ifdef _WIN32
+        localtime_s(&tm, &t);
+#else
+        localtime_r(&t, &tm);
+#endif
+        for (auto& p : parts) {
+            if (p.digits || p.fmt.empty()) continue;
+            char str[256];
+            p.text.assign(str, std::strftime(str, sizeof(str), p.fmt.c_str(), &tm));
+        }
+        cached_sec = sec;
+    }
+
+    std::vector<part> parts;
+    uint32_t compiled_version = 0;
+    int64_t cached_sec = INT64_MIN;
+};
+
+inline void format_time(format_buffer& buf, int64_t ns) {
+    thread_local time_formatter formatter;
+    formatter.format(buf, ns);
+    buf.append("\n\t");
+}
+
+// fatal records must not sit in the queue when the process goes down
+inline void after_record(log_level lev) {
+    if (lev == log_level::fatal)
+        flush();
+}
+
+// what comes in front of the message, trivially copyable so it can be deferred
+struct level_prefix {
+    log_level lev;
+    log_level level() const {return lev;}
+    size_t write(format_buffer& buf, std::string_view fmt, format_args args) const {
+        return format_titled(buf, log_level_name(lev), fmt, args);
+    }
+};
+
+struct location_prefix {
+    log_level lev;
+    std::source_location loc;
+    log_level level() const {return lev;}
+    size_t write(format_buffer& buf, std::string_view fmt, format_args args) const {
+        format_location(buf, loc);
+        return format_titled(buf, log_level_name(lev), fmt, args);
+    }
+};
+
+struct time_prefix {
+    log_level lev;
+    int64_t time; // nanoseconds since the epoch
+    log_level level() const {return lev;}
+    size_t write(format_buffer& buf, std::string_view fmt, format_args args) const {
+        format_time(buf, time);
+        return format_titled(buf, log_level_name(lev), fmt, args);
+    }
+};
+
+/**
+ * static description of one log statement, the *_LOG macros keep one per call site
+ * so records only refer to it and the format string is never copied
+ */
+struct log_site {
+    log_level lev;
+    std::string_view fmt;
+    std::source_location loc;
+    bool with_location = false; // print the location like location_*
+    mutable std::atomic<uint32_t> id = 0; // numbered on first use by binary output
+};
+
+struct site_prefix {
+    const log_site* site;
+    log_level level() const {return site->lev;}
+    std::string_view fmt() const {return site->fmt;}
+    size_t write(format_buffer& buf, std::string_view fmt, format_args args) const {
+        if (site->with_location)
+            format_location(buf, site->loc);
+        return format_titled(buf, log_level_name(site->lev), fmt, args);
+    }
+};
+
+// prefixes that know their format string, the record does not carry it
+template <class P>
+concept fmt_prefix = requires (const P& p) {
+    {p.fmt()} -> std::convertible_to<std::string_view>;
+};
+
+/**
+ * arguments copied byte for byte into deferred records
+ * specialize for trivially copyable types that own everything they print
+ */
+template <class T, class = void>
+struct deferred_copy : std::bool_constant<std::is_arithmetic_v<T> || std::is_null_pointer_v<T> ||
+                                          std::is_same_v<T, const void*> || std::is_same_v<T, void*>> {};
+
+// strings are copied into the record and come back as string_view
+template <class T>
+constexpr bool deferred_string = std::is_same_v<std::decay_t<T>, const char*> ||
+                                 std::is_same_v<std::decay_t<T>, char*> ||
+                                 std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>;
+
+template <class T>
+constexpr bool deferrable = deferred_string<T> || deferred_copy<T>::value;
+
+template <class T>
+using deferred_t = std::conditional_t<deferred_string<T>, std::string_view, T>;
+
+template <class T>
+std::string_view deferred_view(const T& v) {
+    if constexpr (std::is_pointer_v<T>)
+        return v ? std::string_view{v} : std::string_view{};
+    else
+        return v;
+}
+
+template <class T>
+size_t captured_size(const T& v) {
+    if constexpr (deferred_string<T>)
+        return sizeof(size_t) + deferred_view(v).size();
+    else
+        return sizeof(T);
+}
+
+template <class T>
+char* capture(char* p, const T& v) {
+    if constexpr (deferred_string<T>) {
+        auto str = deferred_view(v);
+        auto size = str.size();
+        std::memcpy(p, &size, sizeof(size));
+        std::memcpy(p + sizeof(size), str.data(), size);
+        return p + sizeof(size) + size;
+    } else {
+        std::memcpy(p, &v, sizeof(T));
+        return p + sizeof(T);
+    }
+}
+
+template <class T>
+deferred_t<T> restore(const char*& p) {
+    if constexpr (deferred_string<T>) {
+        size_t size;
+        std::memcpy(&size, p, sizeof(size));
+        std::string_view str{p + sizeof(size), size};
+        p += sizeof(size) + size;
+        return str;
+    } else {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+        return v;
+    }
+}
+
+// literals are stored as a pointer, anything else is copied after a flagged size
+constexpr size_t copied_fmt = size_t{1} << (sizeof(size_t) * 8 - 1);
+
+inline size_t captured_size(const log_fmt& fmt) {
+    return sizeof(size_t) + (fmt.is_static ? sizeof(const char*) : fmt.str.size());
+}
+
+inline char* capture(char* p, const log_fmt& fmt) {
+    size_t size = fmt.str.size() | (fmt.is_static ? 0 : copied_fmt);
+    std::memcpy(p, &size, sizeof(size));
+    p += sizeof(size);
+    if (fmt.is_static) {
+        auto ptr = fmt.str.data();
+        std::memcpy(p, &ptr, sizeof(ptr));
+        return p + sizeof(ptr);
+    }
+    std::memcpy(p, fmt.str.data(), fmt.str.size());
+    return p + fmt.str.size();
+}
+
+inline std::string_view restore_fmt(const char*& p) {
+    size_t size;
+    std::memcpy(&size, p, sizeof(size));
+    p += sizeof(size);
+    if (size & copied_fmt) {
+        size &= ~copied_fmt;
+        std::string_view str{p, size};
+        p += size;
+        return str;
+    }
+    const char* ptr;
+    std::memcpy(&ptr, p, sizeof(ptr));
+    p += sizeof(ptr);
+    return {ptr, size};
+}
+
+template <class P, class...Args>
+log_record decode_deferred(format_buffer& buf, const char* p, size_t) {
+    P prefix;
+    std::memcpy(&prefix, p, sizeof(P));
+    p += sizeof(P);
+    std::string_view fmt;
+    if constexpr (fmt_prefix<P>)
+        fmt = prefix.fmt();
+    else
+        fmt = restore_fmt(p);
+    // braced initialization restores the arguments left to right
+    std::tuple<deferred_t<Args>...> args{restore<Args>(p)...};
+    return std::apply([&](const auto&...v) {
+        auto begin = prefix.write(buf, fmt, make_format_args(v...));
+        return make_record(buf, begin, buf.size() - 1, prefix.level(), true);
+    }, args);
+}
+
+/**
+ * with the async backend running and every argument deferrable, only the raw
+ * bytes are queued and all formatting happens on the backend thread
+ */
+template <class P, class...Args>
+bool try_defer(const P& prefix, const log_fmt& fmt, const Args&...args) {
+    if constexpr ((deferrable<Args> && ...)) {
+        if (!backend.active()) return false;
+        size_t size = sizeof(P) + (fmt_prefix<P> ? 0 : captured_size(fmt)) + (captured_size(args) + ... + 0);
+        return backend.push(decode_deferred<P, Args...>, size, [&](char* p) {
+            std::memcpy(p, &prefix, sizeof(P));
+            p += sizeof(P);
+            if constexpr (!fmt_prefix<P>)
+                p = capture(p, fmt);
+            ((p = capture(p, args)), ...);
+        }, prefix.level());
+    } else {
+        return false;
+    }
+}
+
+/**
+ * structured records, log_info("request done", kv("ms", dt), kv("path", p))
+ * the text shows the fields as key=value after the message, sinks with
+ * json_layout get them as JSON members, both are rendered once by the caller
+ */
+template <class T>
+struct log_kv {
+    std::string_view key;
+    const T& value; // only used during the log call
+};
+
+template <class T>
+log_kv<T> kv(std::string_view key, const T& value) {return {key, value};}
+
+template <class T>
+inline constexpr bool is_kv = false;
+template <class T>
+inline constexpr bool is_kv<log_kv<T>> = true;
+
+template <class T>
+void write_json_value(format_buffer& buf, const T& v) {
+    if constexpr (std::is_same_v<T, bool>) {
+        buf.append(v ? "true" : "false");
+    } else if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char>) {
+        if constexpr (std::is_floating_point_v<T>)
+            if (v != v || v - v != 0) return buf.append("null"); // nan and inf are not JSON
+        format_to(buf, "{}", v);
+    } else if constexpr (is_string<T>::value) {
+        write_json_string(buf, std::string_view{v});
+    } else {
+        memory_buffer str;
+        format_arg(str, {}, v);
+        write_json_string(buf, str.view());
+    }
+}
+
+template <class T>
+void write_text_value(format_buffer& buf, const T& v) {
+    if constexpr (is_string<T>::value) {
+        // quoted only where the value would not read back as one token
+        std::string_view str{v};
+        if (str.empty() || str.find_first_of(" =\"\\\n\t") != str.npos)
+            return write_json_string(buf, str);
+        buf.append(str);
+    } else {
+        format_arg(buf, {}, v);
+    }
+}
+
+template <class P, class...T>
+void kv_log(const P& prefix, std::string_view msg, const log_kv<T>&...fields) {
+    using fields_t = std::tuple<const log_kv<T>&...>;
+    fields_t tuple{fields...};
+    erased_arg args[2] = {erased_arg::make(msg), {}};
+    args[1].type = erased_arg::kind::custom;
+    args[1].custom = {&tuple, [](format_buffer& buf, std::string_view, const void* p) {
+        std::apply([&](const auto&...f) {
+            ((buf.push_back(' '), buf.append(f.key), buf.push_back('='), write_text_value(buf, f.value)), ...);
+        }, *static_cast<const fields_t*>(p));
+    }};
+
+    memory_buffer buf;
+    auto begin = prefix.write(buf, "{}{}", format_args{args, 2});
+    auto text_end = buf.size();
+    bool first = true;
+    ((buf.append(first ? "" : ","), first = false, write_json_string(buf, fields.key), buf.push_back(':'),
+      write_json_value(buf, fields.value)), ...);
+
+    auto all = buf.view();
+    auto text = all.substr(0, text_end);
+    write_record({prefix.level(), true, text, text.substr(begin, msg.size()), all.substr(text_end), log_clock_now()});
+}
+
+template <class P>
+void vprefixed_log(const P& prefix, std::string_view fmt, format_args args) {
+    memory_buffer buf;
+    auto begin = prefix.write(buf, fmt, args);
+    write_record(make_record(buf, begin, buf.size() - 1, prefix.level(), true));
+}
+
+template <class P, class...Args>
+void prefixed_log(const P& prefix, const log_fmt& fmt, const Args&...args) {
+    if constexpr (sizeof...(Args) > 0 && (is_kv<Args> && ...))
+        kv_log(prefix, fmt.str, args...);
+    else if (!try_defer(prefix, fmt, args...))
+        vprefixed_log(prefix, fmt.str, make_format_args(args...));
+    after_record(prefix.level());
+}
+
+/**
+ * compact binary output of the *_LOG sites, sample/logdec.cc turns it back into text
+ * stream: "SELOGBIN", u32 version, then entries
+ *   site    u8 1, varint id, u8 level, u8 with_location, varint line,
+ *           str file, str function, str format, varint count, u8 types[count]
+ *   record  u8 2, varint id, zigzag varint ns since the previous record, arguments
+ * strings are varint size + bytes, anything else is raw in host byte order,
+ * arguments of other types are formatted with "{}" and stored as strings
+ */
+enum class binary_type : uint8_t {
+    boolean, character,
+    int8, int16, int32, int64,
+    uint8, uint16, uint32, uint64,
+    float32, float64, float80,
+    string, pointer
+};
+
+inline constexpr char binary_magic[8] = {'S', 'E', 'L', 'O', 'G', 'B', 'I', 'N'};
+inline constexpr uint32_t binary_version = 1;
+
+template <class T>
+constexpr binary_type binary_type_of() {
+    using enum binary_type;
+    if constexpr (std::is_same_v<T, bool>) return boolean;
+    else if constexpr (std::is_same_v<T, char>) return character;
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        return sizeof(T) == 1 ? int8 : sizeof(T) == 2 ? int16 : sizeof(T) == 4 ? int32 : int64;
+    else if constexpr (std::is_integral_v<T>)
+        return sizeof(T) == 1 ? uint8 : sizeof(T) == 2 ? uint16 : sizeof(T) == 4 ? uint32 : uint64;
+    else if constexpr (std::is_same_v<T, float>) return float32;
+    else if constexpr (std::is_same_v<T, double>) return float64;
+    else if constexpr (std::is_same_v<T, long double>) return float80;
+    else if constexpr (std::is_pointer_v<T> && !deferred_string<T> &&
+                       !std::is_function_v<std::remove_pointer_t<T>>) return pointer;
+    else return string;
+}
+
+inline uint32_t site_id(const log_site& site) {
+    static std::atomic<uint32_t> next = 1;
+    auto id = site.id.load(std::memory_order_acquire);
+    if (id) return id;
+    uint32_t fresh = next.fetch_add(1, std::memory_order_relaxed);
+    return site.id.compare_exchange_strong(id, fresh, std::memory_order_acq_rel) ? fresh : id;
+}
+
+// writes the binary stream, calls are serialized by binary_mutex
+class binary_log {
+public:
+    explicit binary_log(const std::string& path) : file(std::fopen(path.c_str(), "wb")) {
+        if (!file)
+            throw std::runtime_error("failed to open binary log: " + path);
+        std::fwrite(binary_magic, 1, sizeof(binary_magic), file);
+        std::fwrite(&binary_version, 1, sizeof(binary_version), file);
+    }
+
+    ~binary_log() {std::fclose(file);}
+
+    template <class...Args>
+    void write(const log_site& site, int64_t time, const Args&...args) {
+        auto id = site_id(site);
+        buf.clear();
+        if (id >= defined.size()) defined.resize(id + 1);
+        if (!defined[id]) {
+            defined[id] = true;
+            buf.push_back(1);
+            put_varint(id);
+            buf.push_back(static_cast<char>(site.lev));
+            buf.push_back(site.with_location);
+            put_varint(site.loc.line());
+            put_string(site.loc.file_name());
+            put_string(site.loc.function_name());
+            put_string(site.fmt);
+            put_varint(sizeof...(Args));
+            (buf.push_back(static_cast<char>(binary_type_of<Args>())), ...);
+        }
+        buf.push_back(2);
+        put_varint(id);
+        auto delta = time - last_time;
+        last_time = time;
+        put_varint((static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+        (put_arg(args), ...);
+        std::fwrite(buf.data(), 1, buf.size(), file);
+    }
+
+    void flush() {std::fflush(file);}
+
+private:
+    void put_varint(uint64_t v) {
+        for (; v >= 0x80; v >>= 7)
+            buf.push_back(static_cast<char>(v | 0x80));
+        buf.push_back(static_cast<char>(v));
+    }
+
+    void put_string(std::string_view str) {
+        put_varint(str.size());
+        buf.append(str);
+    }
+
+    template <class T>
+    void put_arg(const T& v) {
+        constexpr auto type = binary_type_of<T>();
+        if constexpr (type == binary_type::pointer) {
+            auto addr = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(static_cast<const void*>(v)));
+            buf.append(reinterpret_cast<const char*>(&addr), reinterpret_cast<const char*>(&addr) + 8);
+        } else if constexpr (type != binary_type::string) {
+            buf.append(reinterpret_cast<const char*>(&v), reinterpret_cast<const char*>(&v) + sizeof(T));
+        } else if constexpr (deferred_string<T>) {
+            put_string(deferred_view(v));
+        } else {
+            memory_buffer str;
+            format_arg(str, {}, v);
+            put_string(str.view());
+        }
+    }
+
+    std::FILE* file;
+    memory_buffer buf;
+    std::vector<bool> defined; // sites already described in this stream
+    int64_t last_time = 0;
+};
+
+inline void binary_log_deleter::operator()(binary_log* out) const {
+    delete out;
+}
+
+inline void flush_binary() {
+    std::lock_guard lock{binary_mutex};
+    if (binary_out) binary_out->flush();
+}
+
+// *_LOG sites go to `path` in the binary format instead of the sinks until close_binary
+inline void open_binary(const std::string& path) {
+    flush();
+    std::unique_ptr<binary_log, binary_log_deleter> out{new binary_log(path)};
+    std::lock_guard lock{binary_mutex};
+    binary_out = std::move(out);
+    binary_active.store(true, std::memory_order_release);
+}
+
+inline void close_binary() {
+    binary_active.store(false, std::memory_order_release);
+    flush();
+    std::lock_guard lock{binary_mutex};
+    binary_out.reset();
+}
+
+// what a deferred binary record starts with
+struct binary_prefix {
+    const log_site* site;
+    int64_t time;
+};
+
+template <class...Args>
+log_record decode_binary(format_buffer&, const char* p, size_t) {
+    binary_prefix prefix;
+    std::memcpy(&prefix, p, sizeof(prefix));
+    p += sizeof(prefix);
+    std::tuple<deferred_t<Args>...> args{restore<Args>(p)...};
+    std::lock_guard lock{binary_mutex};
+    if (binary_out)
+        std::apply([&](const auto&...v) {binary_out->write(*prefix.site, prefix.time, v...);}, args);
+    return {};
+}
+
+// arguments that cannot be copied are stored as text anyway, format them before queueing
+template <class T>
+using binary_value_t = std::conditional_t<deferrable<T>, const T&, std::string>;
+
+template <class T>
+binary_value_t<T> binary_value(const T& v) {
+    if constexpr (deferrable<T>)
+        return v;
+    else
+        return format("{}", v);
+}
+
+template <class...Args>
+void binary_site_log(const log_site& site, const Args&...args) {
+    auto time = log_clock_now();
+    if (backend.active()) {
+        binary_prefix prefix{&site, time};
+        std::tuple<binary_value_t<Args>...> values{binary_value(args)...};
+        bool pushed = std::apply([&](const auto&...v) {
+            size_t size = sizeof(prefix) + (captured_size(v) + ... + 0);
+            return backend.push(decode_binary<std::remove_cvref_t<binary_value_t<Args>>...>, size, [&](char* p) {
+                std::memcpy(p, &prefix, sizeof(prefix));
+                p += sizeof(prefix);
+                ((p = capture(p, v)), ...);
+            }, site.lev);
+        }, values);
+        if (pushed) return;
+    }
+    std::lock_guard lock{binary_mutex};
+    if (binary_out) binary_out->write(site, time, args...);
+}
+
+// what the *_LOG macros call once the level check passed
+template <class...Args>
+void site_log(const log_site& site, const Args&...args) {
+    if constexpr (!(is_kv<Args> || ...)) {
+        if (binary_active.load(std::memory_order_relaxed)) {
+            binary_site_log(site, args...);
+            after_record(site.lev);
+            return;
+        }
+    }
+    prefixed_log(site_prefix{&site}, site.fmt, args...);
+}
+
+/**
+ * limits for a single call site, see LIMITED_LOG in se_tools.h
+ *   per_second(n)  token bucket, bursts of up to n records, reports how many were dropped
+ *   one_in(n)      the first record and then every n-th one
+ *   first(n)       the first n records, silent afterwards
+ * n must not be 0
+ */
+struct log_limit {
+    enum class kind : uint8_t {rate, sample, first};
+    kind type;
+    uint32_t n;
+};
+
+constexpr log_limit per_second(uint32_t n) {return {log_limit::kind::rate, n};}
+constexpr log_limit one_in(uint32_t n) {return {log_limit::kind::sample, n};}
+constexpr log_limit first(uint32_t n) {return {log_limit::kind::first, n};}
+
+// the mutable half of a limited site, constant initialized so the static needs no guard
+class site_limit {
+public:
+    constexpr explicit site_limit(log_limit limit) : limit(limit) {}
+
+    bool allow() {
+        switch (limit.type) {
+        case log_limit::kind::rate:
+            return take_token();
+        case log_limit::kind::sample:
+            return count.fetch_add(1, std::memory_order_relaxed) % limit.n == 0;
+        case log_limit::kind::first:
+            // stop counting once silent so the counter can not wrap around
+            return count.load(std::memory_order_relaxed) < limit.n &&
+                   count.fetch_add(1, std::memory_order_relaxed) < limit.n;
+        }
+        return true;
+    }
+
+    // records dropped by the token bucket since the last call
+    uint64_t take_suppressed() {
+        if (suppressed.load(std::memory_order_relaxed) == 0) return 0;
+        return suppressed.exchange(0, std::memory_order_relaxed);
+    }
+
+private:
+    static int64_t now() {
+#ifdef CLOCK_MONOTONIC_COARSE
+        // a few ns instead of a full clock read, its ms resolution is plenty for per second limits
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return int64_t(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // GCRA: `next` is when the bucket would be full again, a record may run it up to a second ahead
+    bool take_token() {
+        const int64_t interval = 1'000'000'000 / limit.n;
+        const int64_t burst = 1'000'000'000 - interval;
+        auto t = now();
+        auto tat = next.load(std::memory_order_relaxed);
+        int64_t start;
+        do {
+            start = std::max(tat, t);
+            if (start - t > burst) {
+                suppressed.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        } while (!next.compare_exchange_weak(tat, start + interval, std::memory_order_relaxed));
+        return true;
+    }
+
+    log_limit limit;
+    std::atomic<uint32_t> count = 0;
+    std::atomic<uint64_t> suppressed = 0;
+    std::atomic<int64_t> next = 0;
+};
+
+// a LIMITED_LOG record that got through, reports what the bucket dropped before it
+template <class...Args>
+void limited_log(const log_site& site, site_limit& limit, const Args&...args) {
+    site_log(site, args...);
+    if (auto n = limit.take_suppressed()) {
+        // laid out like the site's own records
+        if (site.with_location)
+            prefixed_log(location_prefix{site.lev, site.loc}, "{} records suppressed by the rate limit", n);
+        else
+            prefixed_log(level_prefix{site.lev}, "{} records suppressed by the rate limit", n);
+    }
+}
+
+inline void vtitled_log(std::string_view title, std::string_view fmt, format_args args) {
+    memory_buffer buf;
+    auto begin = format_titled(buf, title, fmt, args);
+    write_record(make_record(buf, begin, buf.size() - 1));
+}
+
+inline void vlevel_log(log_level lev, std::string_view fmt, format_args args) {
+    if (!enabled(lev)) return;
+    vprefixed_log(level_prefix{lev}, fmt, args);
+    after_record(lev);
+}
+
+inline void vlocation_log(with_source_localtion<std::string_view> title, std::string_view fmt, format_args args) {
+    memory_buffer buf;
+    format_location(buf, title.location);
+    auto begin = format_titled(buf, title.get(), fmt, args);
+    write_record(make_record(buf, begin, buf.size() - 1));
+}
+
+inline void vlocation_log(with_source_localtion<log_level> lev, std::string_view fmt, format_args args) {
+    if (!enabled(lev.get())) return;
+    vprefixed_log(location_prefix{lev.get(), lev.location}, fmt, args);
+    after_record(lev.get());
+}
+
+inline int64_t log_now() {
+    return log_clock_now();
+}
+
+inline void vtime_log(std::string_view title, std::string_view fmt, format_args args) {
+    memory_buffer buf;
+    format_time(buf, log_now());
+    auto begin = format_titled(buf, title, fmt, args);
+    write_record(make_record(buf, begin, buf.size() - 1));
+}
+
+inline void vtime_log(log_level lev, std::string_view fmt, format_args args) {
+    if (!enabled(lev)) return;
+    vprefixed_log(time_prefix{lev, log_now()}, fmt, args);
+    after_record(lev);
+}
+
 template <class...Args>
-void titled_log(std::string_view title, std::string_view fmt, Args...args) {
-    auto fmt_str = "[{}]: " + std::string(fmt.data(), fmt.size());
-    print_ln(fmt_str, title, std::forward<Args>(args)...);
+void titled_log(std::string_view title, std::string_view fmt, const Args&...args) {
+    vtitled_log(title, fmt, make_format_args(args...));
 }
 
 template <class...Args>
-void location_log(with_source_localtion<std::string_view> title, std::string_view fmt, Args...args) {
-    print_tab("{}:{} in {}:", title.location.file_name(), title.location.line(), title.location.function_name());
-    titled_log(title.get(), fmt, std::forward<Args>(args)...);
+void location_log(with_source_localtion<std::string_view> title, std::string_view fmt, const Args&...args) {
+    vlocation_log(title, fmt, make_format_args(args...));
 }
 
 template <class...Args>
-void location_log(with_source_localtion<log_level> lev, std::string_view fmt, Args...args) {
-    if (lev.get() < min_lev) return;
-    print_tab("{}:{} in {}:", lev.location.file_name(), lev.location.line(), lev.location.function_name());
-    titled_log(log_level_name(lev.get()), fmt, std::forward<Args>(args)...);
+void location_log(with_source_localtion<log_level> lev, const log_fmt& fmt, const Args&...args) {
+    if (!enabled(lev.get())) return;
+    prefixed_log(location_prefix{lev.get(), lev.location}, fmt, args...);
 }
 
 template <class...Args>
-void time_log(std::string_view title, std::string_view fmt, Args...args) {
-    // std::chrono::zoned_time now{std::chrono::current_zone(), std::chrono::high_resolution_clock::now()};
-    // (*op_stream) << "[ " << now << " ]:" << "\n\t";
-    // titled_log(title, fmt, std::forward<Args>(args)...);
-    auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    auto tm = std::localtime(&now);
-    (*op_stream) << std::put_time(tm, time_format.c_str()) << "\n\t";
-    titled_log(title, fmt, std::forward<Args>(args)...);
+void time_log(std::string_view title, std::string_view fmt, const Args&...args) {
+    vtime_log(title, fmt, make_format_args(args...));
 }
 
 template <class...Args>
-void time_log(log_level lev, std::string_view fmt, Args...args) {
-    if (lev < min_lev) return;
-    // std::chrono::zoned_time now{std::chrono::current_zone(), std::chrono::high_resolution_clock::now()};
-    // (*op_stream) << "[ " << now << " ]:" << "\n\t";
-    // titled_log(log_level_name(lev), fmt, std::forward<Args>(args)...);
-    auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
-    auto tm = std::localtime(&now);
-    (*op_stream) << std::put_time(tm, time_format.c_str()) << "\n\t";
-    titled_log(log_level_name(lev), fmt, std::forward<Args>(args)...);
+void time_log(log_level lev, const log_fmt& fmt, const Args&...args) {
+    if (!enabled(lev)) return;
+    prefixed_log(time_prefix{lev, log_now()}, fmt, args...);
 }
 
 #define _func(x) template <class...Args> \
-    void log_##x(std::string_view fmt, Args...args) {if (log_level::x < min_lev) return; titled_log(log_level_name(log_level::x), fmt, std::forward<Args>(args)...);}
+    void log_##x(const log_fmt& fmt, const Args&...args) {if (!enabled(log_level::x)) return; prefixed_log(level_prefix{log_level::x}, fmt, args...);}
     FOREACH_LOG_LEVEL(_func)
 #undef _func
 
 #define _func(x) template <class...Args> \
-    void location_##x(with_source_localtion<std::string_view> fmt, Args...args) {location_log({log_level::x, fmt.location}, fmt.get(), std::forward<Args>(args)...);}
+    void location_##x(with_source_localtion<log_fmt> fmt, const Args&...args) {location_log({log_level::x, fmt.location}, fmt.get(), args...);}
     FOREACH_LOG_LEVEL(_func)
 #undef _func
 
 #define _func(x) template <class...Args> \
-    void time_##x(std::string_view fmt, Args...args) {time_log(log_level::x, fmt, std::forward<Args>(args)...);}
+    void time_##x(const log_fmt& fmt, const Args&...args) {time_log(log_level::x, fmt, args...);}
     FOREACH_LOG_LEVEL(_func)
 #undef _func
 
 }
 
-#undef FMT
 #undef FOREACH_LOG_LEVEL
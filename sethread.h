@@ -1,24 +1,46 @@
 #pragma once
 #include <functional>
 #include <queue>
-#include <vector>
+#include <deque>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
+#include <algorithm>
 
 
 namespace st {
 
+/**
+ * idle workers spin for a while and then sleep on m_task_cv until a task is added
+ * the spin adapts per worker: it grows when spinning found work and shrinks when it did not
+ */
 struct TaskQueue {
+    static constexpr uint32_t min_spin        = 16;
+    static constexpr uint32_t max_spin        = 2048;
+    static constexpr uint32_t completion_spin = 256;
+
     std::queue<std::function<void()>> m_tasks;
-    std::mutex                        m_mutex;
+    mutable std::mutex                m_mutex;
+    std::condition_variable           m_task_cv;
+    mutable std::condition_variable   m_done_cv;
+    uint32_t                          m_sleeping = 0; // workers waiting on m_task_cv, guarded by m_mutex
+    std::atomic<uint32_t>             m_queued = 0;   // tasks not taken yet, lets spinning skip the lock
     std::atomic<uint32_t>             m_remaining_tasks = 0;
 
     template<typename TCallback>
     void addTask(TCallback&& callback) {
-        std::lock_guard<std::mutex> lock_guard{m_mutex};
-        m_tasks.push(std::forward<TCallback>(callback));
-        m_remaining_tasks++;
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lock_guard{m_mutex};
+            m_tasks.push(std::forward<TCallback>(callback));
+            m_queued++;
+            m_remaining_tasks++;
+            wake = m_sleeping > 0;
+        }
+        if (wake) {
+            m_task_cv.notify_one();
+        }
     }
 
     void getTask(std::function<void()>& target_callback) {
@@ -29,21 +51,67 @@ struct TaskQueue {
             }
             target_callback = std::move(m_tasks.front());
             m_tasks.pop();
+            m_queued--;
         }
     }
 
+    // spins up to `spin` rounds, then sleeps until a task arrives or `running` turns false
+    void waitTask(std::function<void()>& target_callback, uint32_t& spin, const std::atomic<bool>& running) {
+        for (uint32_t i{0}; i < spin; ++i) {
+            if (m_queued.load(std::memory_order_relaxed) > 0) {
+                getTask(target_callback);
+                if (target_callback != nullptr) {
+                    spin = std::min(spin * 2, max_spin);
+                    return;
+                }
+            }
+            if (!running.load(std::memory_order_relaxed)) {
+                return;
+            }
+            wait();
+        }
+        spin = std::max(spin / 2, min_spin);
+
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_sleeping++;
+        m_task_cv.wait(lock, [&]{ return !m_tasks.empty() || !running.load(std::memory_order_relaxed); });
+        m_sleeping--;
+        if (!m_tasks.empty()) {
+            target_callback = std::move(m_tasks.front());
+            m_tasks.pop();
+            m_queued--;
+        }
+    }
+
+    // wakes every sleeping worker so it can see that it was stopped
+    void wakeAll() {
+        {
+            std::lock_guard<std::mutex> lock_guard{m_mutex};
+        }
+        m_task_cv.notify_all();
+    }
+
     static void wait() {
         std::this_thread::yield();
     }
 
+    // spins shortly for tasks that are about to finish, then sleeps until the last one is done
     void waitForCompletion() const {
-        while (m_remaining_tasks > 0) {
+        for (uint32_t i{0}; i < completion_spin && m_remaining_tasks > 0; ++i) {
             wait();
         }
+        if (m_remaining_tasks == 0) {
+            return;
+        }
+        std::unique_lock<std::mutex> lock{m_mutex};
+        m_done_cv.wait(lock, [&]{ return m_remaining_tasks == 0; });
     }
 
     void workDone() {
-        m_remaining_tasks--;
+        if (--m_remaining_tasks == 0) {
+            std::lock_guard<std::mutex> lock_guard{m_mutex};
+            m_done_cv.notify_all();
+        }
     }
 };
 
@@ -51,7 +119,8 @@ struct Worker {
     uint32_t              m_id      = 0;
     std::thread           m_thread;
     std::function<void()> m_task    = nullptr;
-    bool                  m_running = true;
+    std::atomic<bool>     m_running = true;
+    uint32_t              m_spin    = TaskQueue::max_spin / 8;
     TaskQueue*            m_queue   = nullptr;
 
     Worker() = default;
@@ -69,8 +138,9 @@ struct Worker {
         while (m_running) {
             m_queue->getTask(m_task);
             if (m_task == nullptr) {
-                TaskQueue::wait();
-            } else {
+                m_queue->waitTask(m_task, m_spin, m_running);
+            }
+            if (m_task != nullptr) {
                 m_task();
                 m_queue->workDone();
                 m_task = nullptr;
@@ -80,6 +150,7 @@ struct Worker {
 
     void stop() {
         m_running = false;
+        m_queue->wakeAll();
         m_thread.join();
     }
 };
@@ -87,12 +158,11 @@ struct Worker {
 struct ThreadPool {
     uint32_t            m_thread_count = 0;
     TaskQueue           m_queue;
-    std::vector<Worker> m_workers;
+    std::deque<Worker>  m_workers; // workers never move, their threads point at them
 
     explicit
     ThreadPool(uint32_t thread_count)
         : m_thread_count{thread_count} {
-        m_workers.reserve(thread_count);
         for (uint32_t i{thread_count}; i--;) {
             m_workers.emplace_back(m_queue, static_cast<uint32_t>(m_workers.size()));
         }
@@ -100,7 +170,11 @@ struct ThreadPool {
 
     virtual ~ThreadPool() {
         for (Worker& worker : m_workers) {
-            worker.stop();
+            worker.m_running = false;
+        }
+        m_queue.wakeAll();
+        for (Worker& worker : m_workers) {
+            worker.m_thread.join();
         }
     }
 